@@ -0,0 +1,95 @@
+#include "corpus_generator.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Distinct lowercase words, short ones for the small ranks
+std::string MakeWord(size_t rank) {
+    std::string word;
+    do {
+        word += static_cast<char>('a' + rank % 26);
+        rank /= 26;
+    } while (rank-- > 0);
+    return word;
+}
+
+}
+
+CorpusGenerator::CorpusGenerator(const CorpusOptions& options)
+    : options_(options)
+    , generator_(options.seed) {
+    words_.reserve(options_.vocabulary_size);
+    cumulative_weights_.reserve(options_.vocabulary_size);
+    double weight_sum = 0.0;
+    for (size_t rank = 0; rank < options_.vocabulary_size; ++rank) {
+        words_.push_back(MakeWord(rank));
+        weight_sum += 1.0 / std::pow(static_cast<double>(rank + 1), options_.zipf_exponent);
+        cumulative_weights_.push_back(weight_sum);
+    }
+}
+
+std::string CorpusGenerator::GenerateDocument() {
+    std::uniform_int_distribution<size_t> word_count(options_.min_document_words, options_.max_document_words);
+    std::string document;
+    for (size_t i = word_count(generator_); i > 0; --i) {
+        document += NextWord();
+        if (i > 1) {
+            document += ' ';
+        }
+    }
+    return document;
+}
+
+std::vector<std::string> CorpusGenerator::GenerateDocuments(size_t count) {
+    std::vector<std::string> documents;
+    documents.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        documents.push_back(GenerateDocument());
+    }
+    return documents;
+}
+
+std::string CorpusGenerator::GenerateQuery(size_t plus_word_count, size_t minus_word_count) {
+    std::string query;
+    for (size_t i = 0; i < plus_word_count + minus_word_count; ++i) {
+        if (!query.empty()) {
+            query += ' ';
+        }
+        if (i >= plus_word_count) {
+            query += '-';
+        }
+        query += NextWord();
+    }
+    return query;
+}
+
+std::vector<std::string> CorpusGenerator::GenerateQueries(size_t count, size_t plus_word_count, size_t minus_word_count) {
+    std::vector<std::string> queries;
+    queries.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        queries.push_back(GenerateQuery(plus_word_count, minus_word_count));
+    }
+    return queries;
+}
+
+const std::string& CorpusGenerator::GetWord(size_t rank) const {
+    return words_[rank];
+}
+
+std::string CorpusGenerator::GetStopWords(size_t count) const {
+    std::string stop_words;
+    for (size_t rank = 0; rank < std::min(count, words_.size()); ++rank) {
+        if (!stop_words.empty()) {
+            stop_words += ' ';
+        }
+        stop_words += words_[rank];
+    }
+    return stop_words;
+}
+
+const std::string& CorpusGenerator::NextWord() {
+    std::uniform_real_distribution<double> weight(0.0, cumulative_weights_.back());
+    const auto it = std::upper_bound(cumulative_weights_.begin(), cumulative_weights_.end(), weight(generator_));
+    return words_[std::min<size_t>(it - cumulative_weights_.begin(), words_.size() - 1)];
+}
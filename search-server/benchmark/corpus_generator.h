@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+struct CorpusOptions {
+    size_t vocabulary_size = 50000;
+    // Word of rank k (from 1) is drawn with weight 1 / k^zipf_exponent
+    double zipf_exponent = 1.0;
+    size_t min_document_words = 10;
+    size_t max_document_words = 60;
+    uint64_t seed = 42;
+};
+
+// Synthetic documents and queries over a Zipf-distributed vocabulary. The same options give
+// the same corpus on every run with the same standard library
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(const CorpusOptions& options);
+
+    std::string GenerateDocument();
+    std::vector<std::string> GenerateDocuments(size_t count);
+    // Words are drawn like document words, minus words get a leading '-'
+    std::string GenerateQuery(size_t plus_word_count, size_t minus_word_count);
+    std::vector<std::string> GenerateQueries(size_t count, size_t plus_word_count, size_t minus_word_count);
+
+    // Word of the given rank, 0 is the most frequent one
+    const std::string& GetWord(size_t rank) const;
+    // The most frequent words separated by spaces, the usual choice of stop words
+    std::string GetStopWords(size_t count) const;
+
+private:
+    const std::string& NextWord();
+
+    CorpusOptions options_;
+    std::mt19937_64 generator_;
+    std::vector<std::string> words_;
+    std::vector<double> cumulative_weights_;
+};
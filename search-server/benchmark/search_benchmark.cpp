@@ -0,0 +1,400 @@
+// Throughput of the main SearchServer operations on synthetic Zipf corpora.
+// Results go to stdout as CSV, one row per operation, corpus size and thread count; progress goes to stderr.
+// Memory rows fill only bytes_per_op, timing rows leave it empty.
+//
+// Build from the search-server directory:
+//   g++ -std=c++17 -O2 -I. benchmark/*.cpp $(ls *.cpp | grep -v main.cpp) -ltbb -lpthread -o search_benchmark
+// Options (defaults in brackets):
+//   --sizes=N,...       corpus sizes [10000,100000]
+//   --threads=N,...     thread counts of the parallel operations [1,2,4,8]
+//   --queries=N         queries per measurement [1000]
+//   --repetitions=N     runs of every query measurement, the median and the best are reported [5]
+//   --seed=N            corpus and query seed [42]
+
+#include "concurrent_map.h"
+#include "corpus_generator.h"
+#include "mutation_log.h"
+#include "posting_list.h"
+#include "process_queries.h"
+#include "query_executor.h"
+#include "search_server.h"
+#include "sharded_search_server.h"
+#include "string_processing.h"
+
+#include <tbb/global_control.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <execution>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+struct BenchmarkOptions {
+    std::vector<size_t> corpus_sizes = { 10000, 100000 };
+    std::vector<size_t> thread_counts = { 1, 2, 4, 8 };
+    size_t query_count = 1000;
+    size_t repetitions = 5;
+    uint64_t seed = 42;
+};
+
+// Results are added here so that the compiler cannot drop the measured calls
+volatile size_t result_sink = 0;
+
+std::vector<size_t> ParseSizes(std::string_view text) {
+    std::vector<size_t> sizes;
+    std::istringstream stream{ std::string(text) };
+    for (std::string item; std::getline(stream, item, ',');) {
+        sizes.push_back(std::stoull(item));
+    }
+    return sizes;
+}
+
+BenchmarkOptions ParseOptions(int argc, char** argv) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view argument = argv[i];
+        const size_t separator = argument.find('=');
+        const std::string_view name = argument.substr(0, separator);
+        const std::string_view value = separator == std::string_view::npos ? ""sv : argument.substr(separator + 1);
+        if (name == "--sizes"sv) {
+            options.corpus_sizes = ParseSizes(value);
+        }
+        else if (name == "--threads"sv) {
+            options.thread_counts = ParseSizes(value);
+        }
+        else if (name == "--queries"sv) {
+            options.query_count = std::stoull(std::string(value));
+        }
+        else if (name == "--repetitions"sv) {
+            options.repetitions = std::max<size_t>(1, std::stoull(std::string(value)));
+        }
+        else if (name == "--seed"sv) {
+            options.seed = std::stoull(std::string(value));
+        }
+        else {
+            throw std::invalid_argument("Unknown option "s + std::string(argument));
+        }
+    }
+    return options;
+}
+
+class ResultWriter {
+public:
+    explicit ResultWriter(std::ostream& output)
+        : output_(output) {
+        output_ << "benchmark,policy,corpus_size,threads,operations,median_ns_per_op,min_ns_per_op,ops_per_second,bytes_per_op"sv << std::endl;
+    }
+
+    void Write(std::string_view benchmark, std::string_view policy, size_t corpus_size, size_t threads, size_t operations,
+        std::vector<double> run_nanoseconds) {
+        std::sort(run_nanoseconds.begin(), run_nanoseconds.end());
+        const double median_ns = run_nanoseconds[run_nanoseconds.size() / 2] / operations;
+        const double min_ns = run_nanoseconds.front() / operations;
+        output_ << benchmark << ',' << policy << ',' << corpus_size << ',' << threads << ',' << operations << ','
+            << median_ns << ',' << min_ns << ',' << 1e9 / median_ns << ',' << std::endl;
+        std::cerr << "  "sv << benchmark << ' ' << policy << " threads="sv << threads << ": "sv << median_ns << " ns/op"sv << std::endl;
+    }
+
+    void WriteMemory(std::string_view benchmark, size_t corpus_size, size_t items, size_t bytes) {
+        const double bytes_per_item = static_cast<double>(bytes) / items;
+        output_ << benchmark << ",seq,"sv << corpus_size << ",1,"sv << items << ",,,,"sv << bytes_per_item << std::endl;
+        std::cerr << "  "sv << benchmark << ": "sv << bytes_per_item << " bytes/item"sv << std::endl;
+    }
+
+private:
+    std::ostream& output_;
+};
+
+template <typename Function>
+double MeasureNanoseconds(Function function) {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Function>
+std::vector<double> MeasureRuns(size_t repetitions, Function function) {
+    std::vector<double> runs;
+    for (size_t i = 0; i < repetitions; ++i) {
+        runs.push_back(MeasureNanoseconds(function));
+    }
+    return runs;
+}
+
+// The ConcurrentMap design before it became lock-free: a mutex and a std::map per bucket.
+// Kept here as the reference point of the contention benchmark
+template <typename Key, typename Value>
+class LockedBucketMap {
+public:
+    explicit LockedBucketMap(size_t bucket_count)
+        : buckets_(bucket_count) {
+    }
+
+    void Add(const Key& key, const Value& delta) {
+        Bucket& bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
+        std::lock_guard guard(bucket.mutex);
+        bucket.values[key] += delta;
+    }
+
+private:
+    struct Bucket {
+        std::mutex mutex;
+        std::map<Key, Value> values;
+    };
+
+    std::vector<Bucket> buckets_;
+};
+
+// Every thread adds to values of random keys out of key_count, like relevance accumulation does
+template <typename Map>
+double MeasureConcurrentAdds(Map& map, const std::vector<std::vector<uint64_t>>& thread_keys) {
+    return MeasureNanoseconds([&] {
+        std::vector<std::thread> threads;
+        for (const std::vector<uint64_t>& keys : thread_keys) {
+            threads.emplace_back([&map, &keys] {
+                for (const uint64_t key : keys) {
+                    map.Add(key, 1.0);
+                }
+                });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        });
+}
+
+void RunConcurrentMapBenchmarks(const BenchmarkOptions& options, size_t key_count, ResultWriter& writer) {
+    const size_t operation_count = 1 << 20;
+    for (const size_t threads : options.thread_counts) {
+        std::mt19937_64 generator(options.seed);
+        std::vector<std::vector<uint64_t>> thread_keys(threads);
+        for (size_t i = 0; i < operation_count; ++i) {
+            thread_keys[i % threads].push_back(generator() % key_count);
+        }
+        // Every run starts from an empty map, building it is not measured
+        std::vector<double> concurrent_runs;
+        std::vector<double> locked_runs;
+        for (size_t i = 0; i < options.repetitions; ++i) {
+            ConcurrentMap<uint64_t, double> concurrent_map(key_count);
+            concurrent_runs.push_back(MeasureConcurrentAdds(concurrent_map, thread_keys));
+            LockedBucketMap<uint64_t, double> locked_map(std::max(1u, std::thread::hardware_concurrency()) * 4);
+            locked_runs.push_back(MeasureConcurrentAdds(locked_map, thread_keys));
+        }
+        writer.Write("ConcurrentMap.Add"sv, "par"sv, key_count, threads, operation_count, std::move(concurrent_runs));
+        writer.Write("LockedBucketMap.Add"sv, "par"sv, key_count, threads, operation_count, std::move(locked_runs));
+    }
+}
+
+// Posting lists built straight from the documents, without the rest of the index
+void RunPostingListBenchmarks(const BenchmarkOptions& options, const std::vector<std::string>& documents, ResultWriter& writer) {
+    std::unordered_map<std::string_view, PostingList> term_postings;
+    std::vector<std::string_view> words;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        words = SplitIntoWords(std::string_view(documents[i]));
+        std::sort(words.begin(), words.end());
+        for (auto it = words.begin(); it != words.end();) {
+            const auto run_end = std::upper_bound(it, words.end(), *it);
+            const uint32_t term_count = static_cast<uint32_t>(run_end - it);
+            term_postings[*it].Add(static_cast<int>(i), term_count, static_cast<double>(term_count) / words.size());
+            it = run_end;
+        }
+    }
+
+    size_t posting_count = 0;
+    size_t memory_usage = 0;
+    for (const auto& [term, postings] : term_postings) {
+        posting_count += postings.Size();
+        memory_usage += postings.GetMemoryUsage();
+    }
+    writer.WriteMemory("PostingList.Memory"sv, documents.size(), posting_count, memory_usage);
+    // Decoding every list from the start, as an exhaustive search of all terms would
+    writer.Write("PostingList.Decode"sv, "seq"sv, documents.size(), 1, posting_count, MeasureRuns(options.repetitions, [&] {
+        uint64_t checksum = 0;
+        for (const auto& [term, postings] : term_postings) {
+            postings.ForEach([&checksum](int document_id, uint32_t term_count) {
+                checksum += static_cast<uint64_t>(document_id) + term_count;
+                });
+        }
+        result_sink = result_sink + checksum;
+        }));
+}
+
+DocumentStatus GetDocumentStatus(size_t index) {
+    // Mostly actual documents, like a live index
+    return index % 10 == 0 ? DocumentStatus::IRRELEVANT : index % 10 == 1 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+}
+
+template <class ExecutionPolicy>
+void RunQueryBenchmarks(ExecutionPolicy&& policy, std::string_view policy_name, const SearchServer& server,
+    const std::vector<std::string>& queries, size_t corpus_size, size_t threads, size_t repetitions, ResultWriter& writer) {
+    writer.Write("FindTopDocuments"sv, policy_name, corpus_size, threads, queries.size(), MeasureRuns(repetitions, [&] {
+        for (const std::string& query : queries) {
+            result_sink = result_sink + server.FindTopDocuments(policy, query).size();
+        }
+        }));
+    writer.Write("FindTopDocuments.status"sv, policy_name, corpus_size, threads, queries.size(), MeasureRuns(repetitions, [&] {
+        for (const std::string& query : queries) {
+            result_sink = result_sink + server.FindTopDocuments(policy, query, DocumentStatus::BANNED).size();
+        }
+        }));
+    writer.Write("FindTopDocuments.predicate"sv, policy_name, corpus_size, threads, queries.size(), MeasureRuns(repetitions, [&] {
+        for (const std::string& query : queries) {
+            result_sink = result_sink + server.FindTopDocuments(policy, query, [](int document_id, DocumentStatus, int rating) {
+                return document_id % 2 == 0 && rating > 0;
+                }).size();
+        }
+        }));
+    writer.Write("MatchDocument"sv, policy_name, corpus_size, threads, queries.size(), MeasureRuns(repetitions, [&] {
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const int document_id = static_cast<int>(i * 7919 % corpus_size);
+            result_sink = result_sink + std::get<0>(server.MatchDocument(policy, queries[i], document_id)).size();
+        }
+        }));
+    // Highlighting a result page: one query matched against MAX_RESULT_DOCUMENT_COUNT documents
+    writer.Write("MatchDocuments"sv, policy_name, corpus_size, threads, queries.size(), MeasureRuns(repetitions, [&] {
+        std::vector<int> document_ids(MAX_RESULT_DOCUMENT_COUNT);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            for (size_t j = 0; j < document_ids.size(); ++j) {
+                document_ids[j] = static_cast<int>((i * MAX_RESULT_DOCUMENT_COUNT + j) * 7919 % corpus_size);
+            }
+            result_sink = result_sink + server.MatchDocuments(policy, queries[i], document_ids).size();
+        }
+        }));
+}
+
+void RunCorpusBenchmarks(const BenchmarkOptions& options, size_t corpus_size, ResultWriter& writer) {
+    CorpusOptions corpus_options;
+    corpus_options.seed = options.seed;
+    CorpusGenerator generator(corpus_options);
+    const std::vector<std::string> documents = generator.GenerateDocuments(corpus_size);
+    const std::vector<std::string> queries = generator.GenerateQueries(options.query_count, 4, 1);
+    const std::string stop_words = generator.GetStopWords(5);
+    std::vector<std::vector<int>> ratings(corpus_size);
+    for (size_t i = 0; i < corpus_size; ++i) {
+        ratings[i] = { static_cast<int>(i % 11) - 3, static_cast<int>(i % 5) };
+    }
+    std::cerr << "corpus "sv << corpus_size << " documents"sv << std::endl;
+    RunPostingListBenchmarks(options, documents, writer);
+
+    // Ingestion is measured once, a repeated run would need a new server anyway
+    SearchServer server(stop_words);
+    writer.Write("AddDocument"sv, "seq"sv, corpus_size, 1, corpus_size, { MeasureNanoseconds([&] {
+        for (size_t i = 0; i < corpus_size; ++i) {
+            server.AddDocument(static_cast<int>(i), documents[i], GetDocumentStatus(i), ratings[i]);
+        }
+        }) });
+    {
+        // The same ingestion through a mutation log, made durable once per group of documents
+        const size_t documents_per_commit = 1000;
+        const std::string log_path = (std::filesystem::temp_directory_path() / "search_benchmark_mutations.log").string();
+        std::filesystem::remove(log_path);
+        SearchServer logged_server(stop_words);
+        {
+            MutationLog log(log_path);
+            writer.Write("AddDocument.logged"sv, "seq"sv, corpus_size, 1, corpus_size, { MeasureNanoseconds([&] {
+                for (size_t i = 0; i < corpus_size; ++i) {
+                    log.AddDocument(logged_server, static_cast<int>(i), documents[i], GetDocumentStatus(i), ratings[i]);
+                    if ((i + 1) % documents_per_commit == 0) {
+                        log.Sync();
+                    }
+                }
+                log.Sync();
+                }) });
+        }
+        std::filesystem::remove(log_path);
+    }
+    std::vector<NewDocument> batch;
+    batch.reserve(corpus_size);
+    for (size_t i = 0; i < corpus_size; ++i) {
+        batch.push_back({ static_cast<int>(i), documents[i], GetDocumentStatus(i), ratings[i] });
+    }
+
+    RunQueryBenchmarks(std::execution::seq, "seq"sv, server, queries, corpus_size, 1, options.repetitions, writer);
+    for (const size_t threads : options.thread_counts) {
+        tbb::global_control parallelism(tbb::global_control::max_allowed_parallelism, threads);
+        {
+            SearchServer batch_server(stop_words);
+            writer.Write("AddDocuments"sv, "par"sv, corpus_size, threads, corpus_size, { MeasureNanoseconds([&] {
+                batch_server.AddDocuments(std::execution::par, batch);
+                }) });
+        }
+        RunQueryBenchmarks(std::execution::par, "par"sv, server, queries, corpus_size, threads, options.repetitions, writer);
+        {
+            // One shard per thread
+            ShardedSearchServer sharded_server(stop_words, threads);
+            writer.Write("Sharded.AddDocuments"sv, "par"sv, corpus_size, threads, corpus_size, { MeasureNanoseconds([&] {
+                sharded_server.AddDocuments(batch);
+                }) });
+            writer.Write("Sharded.FindTopDocuments"sv, "par"sv, corpus_size, threads, queries.size(), MeasureRuns(options.repetitions, [&] {
+                for (const std::string& query : queries) {
+                    result_sink = result_sink + sharded_server.FindTopDocuments(std::execution::par, query).size();
+                }
+                }));
+        }
+
+        QueryExecutor executor(threads);
+        writer.Write("ProcessQueries"sv, "executor"sv, corpus_size, threads, queries.size(), MeasureRuns(options.repetitions, [&] {
+            result_sink = result_sink + ProcessQueries(executor, server, queries).size();
+            }));
+        writer.Write("ProcessQueriesJoined"sv, "executor"sv, corpus_size, threads, queries.size(), MeasureRuns(options.repetitions, [&] {
+            result_sink = result_sink + ProcessQueriesJoined(executor, server, queries).size();
+            }));
+    }
+
+    // Every tenth document is removed from copies of the built server
+    std::vector<int> removed_ids;
+    for (size_t i = 0; i < corpus_size; i += 10) {
+        removed_ids.push_back(static_cast<int>(i));
+    }
+    {
+        SearchServer copy = server;
+        writer.Write("RemoveDocument"sv, "seq"sv, corpus_size, 1, removed_ids.size(), { MeasureNanoseconds([&] {
+            for (const int document_id : removed_ids) {
+                copy.RemoveDocument(std::execution::seq, document_id);
+            }
+            }) });
+    }
+    for (const size_t threads : options.thread_counts) {
+        tbb::global_control parallelism(tbb::global_control::max_allowed_parallelism, threads);
+        SearchServer copy = server;
+        writer.Write("RemoveDocument"sv, "par"sv, corpus_size, threads, removed_ids.size(), { MeasureNanoseconds([&] {
+            for (const int document_id : removed_ids) {
+                copy.RemoveDocument(std::execution::par, document_id);
+            }
+            }) });
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    try {
+        const BenchmarkOptions options = ParseOptions(argc, argv);
+        ResultWriter writer(std::cout);
+        for (const size_t corpus_size : options.corpus_sizes) {
+            RunCorpusBenchmarks(options, corpus_size, writer);
+            // The key space is the corpus: one accumulated value per document id
+            RunConcurrentMapBenchmarks(options, corpus_size, writer);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,50 +1,263 @@
 #pragma once
-#include <cstdlib>
-#include <future>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <execution>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
-#include <random>
-#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <algorithm>
-
-using namespace std::string_literals;
 
-template <typename Key, typename Value>
+// Hash map for concurrent updates. Keys live in open-addressing shards and are never removed,
+// values are atomics updated by compare-and-swap, so lookups and updates of present keys take
+// no locks. Inserting a new key locks its shard. A shard grows without bound by adding tables
+// of twice the size, and slots never move, so references to values stay valid
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
 class ConcurrentMap {
 public:
-    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
+    static_assert(std::is_trivially_copyable_v<Value>, "ConcurrentMap values must be trivially copyable");
 
-    struct Access {
-    private:
-        std::lock_guard<std::mutex> guard_;
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    // expected_key_count only sizes the first tables, more keys make the shards grow
+    explicit ConcurrentMap(size_t expected_key_count, size_t shard_count = std::max(1u, std::thread::hardware_concurrency()) * 4)
+        : shards_(std::max<size_t>(shard_count, 1)) {
+        const size_t shard_key_count = (expected_key_count + shards_.size() - 1) / shards_.size();
+        for (Shard& shard : shards_) {
+            shard.Init(shard_key_count);
+        }
+    }
+
+    // Stands in for the locked Value& of the old operator[]: every operation on it is atomic by itself,
+    // a sequence of them is not
+    class ValueReference {
     public:
-        Value& ref_to_value;
-        Access(std::map<Key, Value>& map, std::mutex& mut, const Key key) :
-            guard_(mut), ref_to_value(map[key]) {
+        explicit ValueReference(std::atomic<Value>& value)
+            : value_(value) {
         }
+
+        operator Value() const {
+            return value_.load(std::memory_order_relaxed);
+        }
+
+        ValueReference& operator=(const Value& value) {
+            value_.store(value, std::memory_order_relaxed);
+            return *this;
+        }
+
+        ValueReference& operator+=(const Value& delta) {
+            UpdateValue(value_, [&delta](const Value& value) { return value + delta; });
+            return *this;
+        }
+
+    private:
+        std::atomic<Value>& value_;
     };
 
-    explicit ConcurrentMap(size_t bucket_count) :concurrent_map_(bucket_count), mut_vec_(bucket_count), size_map_(bucket_count) {
+    struct Access {
+        ValueReference ref_to_value;
+    };
 
-    }
     Access operator[](const Key& key) {
-        uint64_t key_u = static_cast<uint64_t>(key);
-        uint64_t num_map = key_u % size_map_;
-        return Access(concurrent_map_[num_map], mut_vec_[num_map], key);
+        return { ValueReference(FindOrInsert(key)) };
+    }
+
+    // Adds delta to the value of key, the value starts from Value{}
+    void Add(const Key& key, const Value& delta) {
+        Update(key, [&delta](const Value& value) { return value + delta; });
+    }
+
+    // Atomically replaces the value of key with updater(old_value)
+    template <typename Updater>
+    void Update(const Key& key, Updater updater) {
+        UpdateValue(FindOrInsert(key), updater);
+    }
 
+    // Returns Value{} for absent keys
+    Value Get(const Key& key) const {
+        const uint64_t hash = MixHash(key);
+        const Slot* slot = FindSlot(shards_[GetShardIndex(hash)], hash, key);
+        return slot == nullptr ? Value{} : slot->value.load(std::memory_order_relaxed);
     }
 
-    std::map<Key, Value> BuildOrdinaryMap() {
-        for (size_t i = 1; i < size_map_; ++i) {
-            std::lock_guard<std::mutex> guard(mut_vec_[i]);
-            concurrent_map_[0].merge(concurrent_map_[i]);
+    // Calls func(key, value) for every key, shards are visited according to the policy.
+    // Concurrent updates may or may not be observed
+    template <typename ExecutionPolicy, typename Func>
+    void ForEach(ExecutionPolicy&& policy, Func func) const {
+        std::for_each(policy, shards_.begin(), shards_.end(), [&func](const Shard& shard) {
+            shard.ForEachSlot([&func](const Slot& slot) {
+                func(slot.key, slot.value.load(std::memory_order_relaxed));
+                });
+            });
+    }
+
+    template <typename ExecutionPolicy>
+    std::map<Key, Value> BuildOrdinaryMap(ExecutionPolicy&& policy) const {
+        // Shards are drained in parallel, the map is then built from one sorted range in linear time
+        std::vector<std::vector<std::pair<Key, Value>>> shard_items(shards_.size());
+        std::vector<size_t> shard_indexes(shards_.size());
+        std::iota(shard_indexes.begin(), shard_indexes.end(), 0);
+        std::for_each(policy, shard_indexes.begin(), shard_indexes.end(), [this, &shard_items](size_t shard_index) {
+            shards_[shard_index].ForEachSlot([&items = shard_items[shard_index]](const Slot& slot) {
+                items.emplace_back(slot.key, slot.value.load(std::memory_order_relaxed));
+                });
+            });
+
+        std::vector<std::pair<Key, Value>> items;
+        for (auto& shard : shard_items) {
+            items.insert(items.end(), std::make_move_iterator(shard.begin()), std::make_move_iterator(shard.end()));
         }
-        return concurrent_map_[0];
+        std::sort(policy, items.begin(), items.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first < rhs.first;
+            });
+        return { std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()) };
+    }
+
+    std::map<Key, Value> BuildOrdinaryMap() const {
+        return BuildOrdinaryMap(std::execution::seq);
     }
+
 private:
-    std::vector<std::map<Key, Value>> concurrent_map_;
-    std::vector<std::mutex> mut_vec_;
-    uint64_t size_map_;
-    std::mutex one_mutex_;
-};
\ No newline at end of file
+    // Table sizes double, so this many tables hold more keys than fit in memory
+    static constexpr size_t MAX_TABLE_COUNT = 48;
+
+    struct Slot {
+        // Set once the key is written, a slot is never emptied again
+        std::atomic<bool> full{ false };
+        Key key{};
+        std::atomic<Value> value{ Value{} };
+    };
+
+    // Padded so that neighbouring shard headers never share a cache line. Table i has
+    // first_table_size << i slots; tables are published by table_count and freed with the shard
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        std::array<std::atomic<Slot*>, MAX_TABLE_COUNT> tables{};
+        std::atomic<size_t> table_count{ 0 };
+        size_t first_table_size = 0;
+        // Guards the members below and serializes inserts. Only the newest table takes new keys
+        std::mutex insert_mutex;
+        size_t newest_table_key_count = 0;
+
+        Shard() = default;
+        Shard(const Shard&) = delete;
+        Shard& operator=(const Shard&) = delete;
+
+        ~Shard() {
+            for (size_t table = 0; table < table_count.load(std::memory_order_relaxed); ++table) {
+                delete[] tables[table].load(std::memory_order_relaxed);
+            }
+        }
+
+        void Init(size_t key_count) {
+            // Keeps the load factor of every table at or below one half
+            first_table_size = 2;
+            while (first_table_size < key_count * 2) {
+                first_table_size *= 2;
+            }
+            AddTable();
+        }
+
+        size_t GetTableMask(size_t table) const {
+            return (first_table_size << table) - 1;
+        }
+
+        void AddTable() {
+            const size_t table = table_count.load(std::memory_order_relaxed);
+            tables[table].store(new Slot[GetTableMask(table) + 1], std::memory_order_relaxed);
+            newest_table_key_count = 0;
+            table_count.store(table + 1, std::memory_order_release);
+        }
+
+        template <typename Func>
+        void ForEachSlot(Func func) const {
+            const size_t count = table_count.load(std::memory_order_acquire);
+            for (size_t table = 0; table < count; ++table) {
+                const Slot* slots = tables[table].load(std::memory_order_relaxed);
+                for (size_t index = 0; index <= GetTableMask(table); ++index) {
+                    if (slots[index].full.load(std::memory_order_acquire)) {
+                        func(slots[index]);
+                    }
+                }
+            }
+        }
+    };
+
+    uint64_t MixHash(const Key& key) const {
+        // Fibonacci hashing spreads sequential integer keys which std::hash maps to themselves
+        return static_cast<uint64_t>(hasher_(key)) * 0x9E3779B97F4A7C15ull;
+    }
+
+    template <typename Updater>
+    static void UpdateValue(std::atomic<Value>& value, Updater updater) {
+        Value expected = value.load(std::memory_order_relaxed);
+        while (!value.compare_exchange_weak(expected, updater(expected), std::memory_order_relaxed)) {
+        }
+    }
+
+    // Shard and slot are taken from different hash bits, otherwise every key of a shard
+    // would start probing from the same residue
+    size_t GetShardIndex(uint64_t hash) const {
+        return static_cast<size_t>(hash >> 48) % shards_.size();
+    }
+
+    static size_t GetFirstSlot(uint64_t hash) {
+        return static_cast<size_t>(hash >> 16);
+    }
+
+    // Probes every table from the oldest; within a table the first empty slot ends the probe,
+    // as a table is never more than half full
+    static Slot* FindSlot(const Shard& shard, uint64_t hash, const Key& key) {
+        const size_t count = shard.table_count.load(std::memory_order_acquire);
+        for (size_t table = 0; table < count; ++table) {
+            Slot* slots = shard.tables[table].load(std::memory_order_relaxed);
+            const size_t mask = shard.GetTableMask(table);
+            for (size_t index = GetFirstSlot(hash);; ++index) {
+                Slot& slot = slots[index & mask];
+                if (!slot.full.load(std::memory_order_acquire)) {
+                    break;
+                }
+                if (slot.key == key) {
+                    return &slot;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    std::atomic<Value>& FindOrInsert(const Key& key) {
+        const uint64_t hash = MixHash(key);
+        Shard& shard = shards_[GetShardIndex(hash)];
+        if (Slot* slot = FindSlot(shard, hash, key)) {
+            return slot->value;
+        }
+
+        std::lock_guard lock(shard.insert_mutex);
+        // Another thread may have inserted the key since the search above
+        if (Slot* slot = FindSlot(shard, hash, key)) {
+            return slot->value;
+        }
+        const size_t table = shard.table_count.load(std::memory_order_relaxed) - 1;
+        Slot* slots = shard.tables[table].load(std::memory_order_relaxed);
+        const size_t mask = shard.GetTableMask(table);
+        size_t index = GetFirstSlot(hash);
+        while (slots[index & mask].full.load(std::memory_order_relaxed)) {
+            ++index;
+        }
+        Slot& slot = slots[index & mask];
+        slot.key = key;
+        slot.full.store(true, std::memory_order_release);
+        if (++shard.newest_table_key_count * 2 > mask + 1) {
+            shard.AddTable();
+        }
+        return slot.value;
+    }
+
+    std::vector<Shard> shards_;
+    Hash hasher_;
+};
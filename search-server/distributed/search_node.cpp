@@ -0,0 +1,292 @@
+// Shard server and coordinator of a search split across processes on one or several hosts.
+//
+// Build from the search-server directory:
+//   g++ -std=c++17 -O2 -I. distributed/*.cpp benchmark/corpus_generator.cpp $(ls *.cpp | grep -v main.cpp) -ltbb -lpthread -o search_node
+// Endpoints are "unix:/path/to/socket", "host:port" or "[ipv6-address]:port". Modes:
+//   search_node shard --listen=ENDPOINT --snapshot=PATH
+//       serves a SearchServer written by SaveSnapshot
+//   search_node shard --listen=ENDPOINT --shard=K --shards=N [--documents=N] [--seed=N]
+//       serves the documents with id % N == K of the synthetic corpus of the benchmark
+//   search_node query --connect=ENDPOINT,... [--timeout-ms=N] QUERY...
+//       prints the top documents of every query
+//   search_node cluster [--shards=N] [--documents=N] [--queries=N] [--timeout-ms=N] [--seed=N]
+//       starts shard processes on Unix sockets, checks the coordinator against one in-process
+//       SearchServer with the whole corpus, then stops a shard to check the timeout handling.
+//       Exits with 1 if any check fails
+
+#include "benchmark/corpus_generator.h"
+#include "search_coordinator.h"
+#include "search_server.h"
+#include "shard_service.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+struct NodeOptions {
+    std::string listen;
+    std::string snapshot;
+    std::vector<std::string> connect;
+    size_t shard = 0;
+    size_t shard_count = 4;
+    size_t document_count = 100000;
+    size_t query_count = 1000;
+    std::chrono::milliseconds timeout = 500ms;
+    uint64_t seed = 42;
+    std::vector<std::string> queries;
+};
+
+std::vector<std::string> SplitList(std::string_view text) {
+    std::vector<std::string> items;
+    std::istringstream stream{ std::string(text) };
+    for (std::string item; std::getline(stream, item, ',');) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+NodeOptions ParseOptions(int argc, char** argv) {
+    NodeOptions options;
+    for (int i = 2; i < argc; ++i) {
+        const std::string_view argument = argv[i];
+        if (argument.substr(0, 2) != "--"sv) {
+            options.queries.emplace_back(argument);
+            continue;
+        }
+        const size_t separator = argument.find('=');
+        const std::string_view name = argument.substr(0, separator);
+        const std::string value(separator == std::string_view::npos ? ""sv : argument.substr(separator + 1));
+        if (name == "--listen"sv) {
+            options.listen = value;
+        }
+        else if (name == "--snapshot"sv) {
+            options.snapshot = value;
+        }
+        else if (name == "--connect"sv) {
+            options.connect = SplitList(value);
+        }
+        else if (name == "--shard"sv) {
+            options.shard = std::stoull(value);
+        }
+        else if (name == "--shards"sv) {
+            options.shard_count = std::max<size_t>(1, std::stoull(value));
+        }
+        else if (name == "--documents"sv) {
+            options.document_count = std::stoull(value);
+        }
+        else if (name == "--queries"sv) {
+            options.query_count = std::stoull(value);
+        }
+        else if (name == "--timeout-ms"sv) {
+            options.timeout = std::chrono::milliseconds(std::stoll(value));
+        }
+        else if (name == "--seed"sv) {
+            options.seed = std::stoull(value);
+        }
+        else {
+            throw std::invalid_argument("Unknown option "s + std::string(argument));
+        }
+    }
+    return options;
+}
+
+// The same corpus as the benchmark: statuses and ratings follow from the document index
+struct Corpus {
+    std::vector<std::string> documents;
+    std::vector<std::string> queries;
+    std::string stop_words;
+};
+
+Corpus GenerateCorpus(const NodeOptions& options) {
+    CorpusOptions corpus_options;
+    corpus_options.seed = options.seed;
+    CorpusGenerator generator(corpus_options);
+    Corpus corpus;
+    corpus.documents = generator.GenerateDocuments(options.document_count);
+    corpus.queries = generator.GenerateQueries(options.query_count, 4, 1);
+    corpus.stop_words = generator.GetStopWords(5);
+    return corpus;
+}
+
+DocumentStatus GetDocumentStatus(size_t index) {
+    return index % 10 == 0 ? DocumentStatus::IRRELEVANT : index % 10 == 1 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+}
+
+std::vector<int> GetDocumentRatings(size_t index) {
+    return { static_cast<int>(index % 11) - 3, static_cast<int>(index % 5) };
+}
+
+// Documents with id % shard_count == shard, every document when shard_count is 1
+SearchServer BuildShardServer(const Corpus& corpus, size_t shard, size_t shard_count) {
+    std::vector<NewDocument> documents;
+    for (size_t i = shard; i < corpus.documents.size(); i += shard_count) {
+        documents.push_back({ static_cast<int>(i), corpus.documents[i], GetDocumentStatus(i), GetDocumentRatings(i) });
+    }
+    SearchServer server(corpus.stop_words);
+    server.AddDocuments(std::execution::par, documents);
+    return server;
+}
+
+int RunShard(const NodeOptions& options) {
+    const SearchServer server = options.snapshot.empty()
+        ? BuildShardServer(GenerateCorpus(options), options.shard, options.shard_count)
+        : SearchServer::LoadSnapshot(options.snapshot);
+    ShardService service(server, options.listen);
+    std::cerr << "shard serves "sv << server.GetDocumentCount() << " documents on "sv << options.listen << std::endl;
+    service.Run();
+    return 0;
+}
+
+int RunQueries(const NodeOptions& options) {
+    SearchCoordinator coordinator(options.connect, options.timeout);
+    for (const std::string& query : options.queries) {
+        const DistributedSearchResult result = coordinator.FindTopDocuments(query);
+        std::cout << "query \""sv << query << "\""sv;
+        if (!result.failed_shards.empty()) {
+            std::cout << ", "sv << result.failed_shards.size() << " shards failed"sv;
+        }
+        std::cout << std::endl;
+        for (const Document& document : result.documents) {
+            std::cout << "  "sv << document << std::endl;
+        }
+    }
+    return 0;
+}
+
+bool WaitForShards(const std::vector<std::string>& endpoints, std::chrono::seconds timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (const std::string& endpoint : endpoints) {
+        while (true) {
+            try {
+                Connection::Connect(endpoint);
+                break;
+            }
+            catch (const std::runtime_error&) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    return false;
+                }
+                std::this_thread::sleep_for(50ms);
+            }
+        }
+    }
+    return true;
+}
+
+bool HaveSameScores(const std::vector<Document>& lhs, const std::vector<Document>& rhs) {
+    // Documents with equal relevance and rating may come in any order
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& lhs, const Document& rhs) {
+        return lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+        });
+}
+
+int RunCluster(const NodeOptions& options) {
+    const Corpus corpus = GenerateCorpus(options);
+    char directory_template[] = "/tmp/search_node.XXXXXX";
+    const std::string directory = mkdtemp(directory_template);
+    std::vector<std::string> endpoints;
+    std::vector<pid_t> shard_pids;
+    // Shards are forked before this process starts any thread
+    for (size_t shard = 0; shard < options.shard_count; ++shard) {
+        endpoints.push_back("unix:"s + directory + "/shard"s + std::to_string(shard) + ".sock"s);
+        const pid_t pid = fork();
+        if (pid == 0) {
+            const SearchServer server = BuildShardServer(corpus, shard, options.shard_count);
+            ShardService service(server, endpoints.back());
+            service.Run();
+            std::_Exit(0);
+        }
+        shard_pids.push_back(pid);
+    }
+
+    const SearchServer reference = BuildShardServer(corpus, 0, 1);
+    bool passed = WaitForShards(endpoints, 600s);
+    SearchCoordinator coordinator(endpoints, options.timeout);
+    if (passed) {
+        size_t mismatches = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (const std::string& query : corpus.queries) {
+            const DistributedSearchResult result = coordinator.FindTopDocuments(query);
+            if (!result.failed_shards.empty() || !HaveSameScores(result.documents, reference.FindTopDocuments(query))) {
+                ++mismatches;
+            }
+        }
+        const auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+        for (size_t i = 0; i < corpus.queries.size() && i < corpus.documents.size(); i += 10) {
+            const auto [words, status] = coordinator.MatchDocument(corpus.queries[i], static_cast<int>(i));
+            const auto [expected_words, expected_status] = reference.MatchDocument(corpus.queries[i], static_cast<int>(i));
+            if (status != expected_status || !std::equal(words.begin(), words.end(), expected_words.begin(), expected_words.end())) {
+                ++mismatches;
+            }
+        }
+        std::cout << corpus.queries.size() << " queries over "sv << options.shard_count << " shards: "sv
+            << elapsed.count() / std::max<size_t>(1, corpus.queries.size()) << " us per query, "sv
+            << mismatches << " mismatches"sv << std::endl;
+        passed = mismatches == 0;
+
+        // A stopped shard must cost one timeout and come back after it resumes
+        if (!corpus.queries.empty()) {
+            kill(shard_pids[0], SIGSTOP);
+            const auto stopped_start = std::chrono::steady_clock::now();
+            const DistributedSearchResult partial = coordinator.FindTopDocuments(corpus.queries[0]);
+            const auto stopped_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - stopped_start);
+            kill(shard_pids[0], SIGCONT);
+            const DistributedSearchResult resumed = coordinator.FindTopDocuments(corpus.queries[0]);
+            std::cout << "stopped shard: "sv << partial.failed_shards.size() << " failed after "sv << stopped_elapsed.count()
+                << " ms, after resuming "sv << resumed.failed_shards.size() << " failed"sv << std::endl;
+            passed = passed && partial.failed_shards == std::vector<size_t>{ 0 } && resumed.failed_shards.empty()
+                && HaveSameScores(resumed.documents, reference.FindTopDocuments(corpus.queries[0]));
+        }
+    }
+    else {
+        std::cerr << "shards did not start"sv << std::endl;
+    }
+
+    for (const pid_t pid : shard_pids) {
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+    }
+    for (const std::string& endpoint : endpoints) {
+        unlink(endpoint.substr("unix:"sv.size()).c_str());
+    }
+    rmdir(directory.c_str());
+    std::cout << (passed ? "PASSED"sv : "FAILED"sv) << std::endl;
+    return passed ? 0 : 1;
+}
+
+}
+
+int main(int argc, char** argv) {
+    try {
+        const std::string_view mode = argc > 1 ? argv[1] : ""sv;
+        const NodeOptions options = ParseOptions(argc, argv);
+        if (mode == "shard"sv) {
+            return RunShard(options);
+        }
+        if (mode == "query"sv) {
+            return RunQueries(options);
+        }
+        if (mode == "cluster"sv) {
+            return RunCluster(options);
+        }
+        std::cerr << "Usage: search_node shard|query|cluster [options], see the top of search_node.cpp"sv << std::endl;
+        return 2;
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,38 @@
+#include "duration_histogram.h"
+#include <algorithm>
+
+size_t DurationHistogram::GetBucket(uint64_t duration) {
+    if (duration < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(duration);
+    }
+    const int exponent = 63 - __builtin_clzll(duration);
+    if (exponent >= MAX_EXPONENT) {
+        return BUCKET_COUNT - 1;
+    }
+    // The leading bit is implied, the next SUB_BUCKET_BITS bits select the sub-bucket
+    const size_t sub_bucket = (duration >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+uint64_t DurationHistogram::GetBucketLowerBound(size_t bucket) {
+    if (bucket < SUB_BUCKET_COUNT) {
+        return bucket;
+    }
+    const int exponent = static_cast<int>(bucket / SUB_BUCKET_COUNT) + SUB_BUCKET_BITS - 1;
+    return (SUB_BUCKET_COUNT + bucket % SUB_BUCKET_COUNT) << (exponent - SUB_BUCKET_BITS);
+}
+
+uint64_t DurationHistogram::GetPercentile(const Counts& counts, uint64_t total_count, double fraction) {
+    if (total_count == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * total_count + 0.5));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            return GetBucketLowerBound(bucket);
+        }
+    }
+    return GetBucketLowerBound(BUCKET_COUNT - 1);
+}
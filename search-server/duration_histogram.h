@@ -0,0 +1,24 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Durations are kept in log-linear buckets like HDR histograms: 16 buckets per power of two,
+// so a percentile is reported within about 6% of the measured value. Buckets do not depend
+// on the unit, every user records durations in its own
+class DurationHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKET_COUNT = size_t{ 1 } << SUB_BUCKET_BITS;
+    // Durations from 2^40 units, about 18 minutes in nanoseconds, share the last bucket
+    static constexpr int MAX_EXPONENT = 40;
+    static constexpr size_t BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    using Counts = std::array<uint64_t, BUCKET_COUNT>;
+
+    static size_t GetBucket(uint64_t duration);
+    // Smallest duration that falls into the bucket
+    static uint64_t GetBucketLowerBound(size_t bucket);
+    // Lower bound of the bucket holding the given fraction of total_count durations, zero if there are none
+    static uint64_t GetPercentile(const Counts& counts, uint64_t total_count, double fraction);
+};
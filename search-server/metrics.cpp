@@ -0,0 +1,138 @@
+#include "metrics.h"
+#include <algorithm>
+
+using namespace std::literals;
+
+std::string_view GetMetricStageName(MetricStage stage) {
+    switch (stage) {
+    case MetricStage::QUERY_PARSE:
+        return "query_parse"sv;
+    case MetricStage::POSTING_TRAVERSAL:
+        return "posting_traversal"sv;
+    case MetricStage::MINUS_WORD_FILTER:
+        return "minus_word_filter"sv;
+    case MetricStage::ACCUMULATOR_MERGE:
+        return "accumulator_merge"sv;
+    case MetricStage::TOP_K_SELECTION:
+        return "top_k_selection"sv;
+    case MetricStage::INGEST_TOKENIZATION:
+        return "ingest_tokenization"sv;
+    }
+    return "unknown"sv;
+}
+
+double StageMetrics::GetMeanNanoseconds() const {
+    return count == 0 ? 0.0 : static_cast<double>(total_nanoseconds) / count;
+}
+
+uint64_t StageMetrics::GetPercentileNanoseconds(double fraction) const {
+    return std::min(max_nanoseconds, DurationHistogram::GetPercentile(buckets, count, fraction));
+}
+
+const StageMetrics& MetricsSnapshot::GetStage(MetricStage stage) const {
+    return stages[static_cast<size_t>(stage)];
+}
+
+void MetricsSnapshot::Dump(std::ostream& output) const {
+    if (!enabled) {
+        output << "metrics are disabled, build with SEARCH_SERVER_METRICS"sv << std::endl;
+        return;
+    }
+    for (const StageMetrics& metrics : stages) {
+        output << GetMetricStageName(metrics.stage) << ": count="sv << metrics.count
+            << " mean_ns="sv << static_cast<uint64_t>(metrics.GetMeanNanoseconds())
+            << " p50_ns="sv << metrics.GetPercentileNanoseconds(0.5)
+            << " p99_ns="sv << metrics.GetPercentileNanoseconds(0.99)
+            << " p999_ns="sv << metrics.GetPercentileNanoseconds(0.999)
+            << " max_ns="sv << metrics.max_nanoseconds << std::endl;
+    }
+}
+
+class MetricsRegistry::ThreadHandle {
+public:
+    explicit ThreadHandle(MetricsRegistry& registry)
+        : registry_(registry)
+        , counters_(registry.AcquireThreadCounters()) {
+    }
+
+    ~ThreadHandle() {
+        registry_.ReleaseThreadCounters(counters_);
+    }
+
+    ThreadCounters& GetCounters() const {
+        return *counters_;
+    }
+
+private:
+    MetricsRegistry& registry_;
+    ThreadCounters* counters_;
+};
+
+MetricsRegistry& MetricsRegistry::GetInstance() {
+    // Never destroyed, so threads finishing during static destruction can still release their blocks
+    static MetricsRegistry* registry = new MetricsRegistry();
+    return *registry;
+}
+
+MetricsRegistry::ThreadCounters& MetricsRegistry::GetThreadCounters() {
+    thread_local const ThreadHandle handle(*this);
+    return handle.GetCounters();
+}
+
+MetricsRegistry::ThreadCounters* MetricsRegistry::AcquireThreadCounters() {
+    const std::lock_guard lock(mutex_);
+    for (const auto& counters : thread_counters_) {
+        if (!counters->in_use) {
+            counters->in_use = true;
+            return counters.get();
+        }
+    }
+    thread_counters_.push_back(std::make_unique<ThreadCounters>());
+    thread_counters_.back()->in_use = true;
+    return thread_counters_.back().get();
+}
+
+void MetricsRegistry::ReleaseThreadCounters(ThreadCounters* counters) {
+    const std::lock_guard lock(mutex_);
+    counters->in_use = false;
+}
+
+void MetricsRegistry::Record(MetricStage stage, uint64_t nanoseconds) {
+    // Only this thread writes its counters, so a plain load and store cannot lose an update
+    const auto add = [](std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    };
+    StageCounters& counters = GetThreadCounters().stages[static_cast<size_t>(stage)];
+    add(counters.count, 1);
+    add(counters.total_nanoseconds, nanoseconds);
+    add(counters.buckets[DurationHistogram::GetBucket(nanoseconds)], 1);
+    if (nanoseconds > counters.max_nanoseconds.load(std::memory_order_relaxed)) {
+        counters.max_nanoseconds.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+MetricsSnapshot MetricsRegistry::GetSnapshot() const {
+    MetricsSnapshot snapshot;
+#ifdef SEARCH_SERVER_METRICS
+    snapshot.enabled = true;
+#endif
+    snapshot.stages.resize(METRIC_STAGE_COUNT);
+    for (size_t stage = 0; stage < METRIC_STAGE_COUNT; ++stage) {
+        snapshot.stages[stage].stage = static_cast<MetricStage>(stage);
+    }
+
+    const std::lock_guard lock(mutex_);
+    for (const auto& thread_counters : thread_counters_) {
+        for (size_t stage = 0; stage < METRIC_STAGE_COUNT; ++stage) {
+            const StageCounters& counters = thread_counters->stages[stage];
+            StageMetrics& metrics = snapshot.stages[stage];
+            metrics.count += counters.count.load(std::memory_order_relaxed);
+            metrics.total_nanoseconds += counters.total_nanoseconds.load(std::memory_order_relaxed);
+            metrics.max_nanoseconds = std::max(metrics.max_nanoseconds, counters.max_nanoseconds.load(std::memory_order_relaxed));
+            for (size_t bucket = 0; bucket < DurationHistogram::BUCKET_COUNT; ++bucket) {
+                metrics.buckets[bucket] += counters.buckets[bucket].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return snapshot;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "duration_histogram.h"
+#include "log_duration.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+// Internal stages of indexing and search that are timed separately
+enum class MetricStage {
+    QUERY_PARSE,
+    POSTING_TRAVERSAL,
+    MINUS_WORD_FILTER,
+    ACCUMULATOR_MERGE,
+    TOP_K_SELECTION,
+    INGEST_TOKENIZATION,
+};
+
+const size_t METRIC_STAGE_COUNT = 6;
+
+std::string_view GetMetricStageName(MetricStage stage);
+
+// Totals of one stage over all threads
+struct StageMetrics {
+    MetricStage stage;
+    uint64_t count = 0;
+    uint64_t total_nanoseconds = 0;
+    uint64_t max_nanoseconds = 0;
+    DurationHistogram::Counts buckets = {};
+
+    double GetMeanNanoseconds() const;
+    // Approximate duration under which the given fraction of the calls finished
+    uint64_t GetPercentileNanoseconds(double fraction) const;
+};
+
+struct MetricsSnapshot {
+    bool enabled = false;
+    std::vector<StageMetrics> stages;
+
+    const StageMetrics& GetStage(MetricStage stage) const;
+    // One line per stage with its call count and latency percentiles
+    void Dump(std::ostream& output) const;
+};
+
+// Per-thread stage counters. Every thread writes only its own block, so recording takes no locks
+// and no atomic read-modify-write; a snapshot sums the blocks of all threads that ever recorded
+class MetricsRegistry {
+public:
+    static MetricsRegistry& GetInstance();
+
+    void Record(MetricStage stage, uint64_t nanoseconds);
+    MetricsSnapshot GetSnapshot() const;
+
+private:
+    struct StageCounters {
+        std::atomic<uint64_t> count = 0;
+        std::atomic<uint64_t> total_nanoseconds = 0;
+        std::atomic<uint64_t> max_nanoseconds = 0;
+        std::array<std::atomic<uint64_t>, DurationHistogram::BUCKET_COUNT> buckets = {};
+    };
+
+    struct alignas(64) ThreadCounters {
+        std::array<StageCounters, METRIC_STAGE_COUNT> stages;
+        // Blocks of finished threads are handed to new ones, their counts stay in the totals
+        bool in_use = false;
+    };
+
+    class ThreadHandle;
+
+    MetricsRegistry() = default;
+    ThreadCounters& GetThreadCounters();
+    ThreadCounters* AcquireThreadCounters();
+    void ReleaseThreadCounters(ThreadCounters* counters);
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadCounters>> thread_counters_;
+};
+
+// Records the lifetime of a scope as one call of a stage, like LogDuration without the output
+class StageTimer {
+public:
+    using Clock = LogDuration::Clock;
+
+    explicit StageTimer(MetricStage stage)
+        : stage_(stage) {
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    ~StageTimer() {
+        const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_);
+        MetricsRegistry::GetInstance().Record(stage_, static_cast<uint64_t>(duration.count()));
+    }
+
+private:
+    const MetricStage stage_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+// Stage timing is compiled in only with SEARCH_SERVER_METRICS defined, otherwise it costs nothing
+#ifdef SEARCH_SERVER_METRICS
+#define METRICS_STAGE(stage) StageTimer UNIQUE_VAR_NAME_PROFILE(stage)
+#else
+#define METRICS_STAGE(stage)
+#endif
@@ -0,0 +1,297 @@
+#include "mutation_log.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::literals;
+
+namespace {
+
+// Every record is its payload size, the CRC32 of the payload and the payload itself
+const size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+std::array<uint32_t, 256> MakeCrc32Table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < table.size(); ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+uint32_t ComputeCrc32(std::string_view data) {
+    static const std::array<uint32_t, 256> table = MakeCrc32Table();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (const char c : data) {
+        crc = table[(crc ^ static_cast<uint8_t>(c)) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+template <typename T>
+void AppendValue(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads values of a payload, any read past its end makes the payload invalid
+class PayloadReader {
+public:
+    explicit PayloadReader(std::string_view payload)
+        : payload_(payload) {
+    }
+
+    template <typename T>
+    T ReadValue() {
+        T value;
+        std::memcpy(&value, ReadBytes(sizeof(value)).data(), sizeof(value));
+        return value;
+    }
+
+    std::string_view ReadBytes(size_t size) {
+        if (size > payload_.size()) {
+            throw std::runtime_error("Mutation log record is corrupted"s);
+        }
+        const std::string_view bytes = payload_.substr(0, size);
+        payload_.remove_prefix(size);
+        return bytes;
+    }
+
+private:
+    std::string_view payload_;
+};
+
+std::string ReadFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return { std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+}
+
+// Calls handler for the payload of every valid record and returns the size of the valid prefix
+template <typename PayloadHandler>
+size_t ForEachRecord(std::string_view data, PayloadHandler handler) {
+    size_t offset = 0;
+    while (data.size() - offset >= RECORD_HEADER_SIZE) {
+        uint32_t payload_size;
+        uint32_t crc;
+        std::memcpy(&payload_size, data.data() + offset, sizeof(payload_size));
+        std::memcpy(&crc, data.data() + offset + sizeof(payload_size), sizeof(crc));
+        if (payload_size > data.size() - offset - RECORD_HEADER_SIZE) {
+            break;
+        }
+        const std::string_view payload = data.substr(offset + RECORD_HEADER_SIZE, payload_size);
+        if (ComputeCrc32(payload) != crc) {
+            break;
+        }
+        handler(payload);
+        offset += RECORD_HEADER_SIZE + payload_size;
+    }
+    return offset;
+}
+
+void SyncDirectory(const std::string& path) {
+    const size_t slash = path.rfind('/');
+    const std::string directory = slash == std::string::npos ? "."s : path.substr(0, std::max<size_t>(slash, 1));
+    const int fd = open(directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+}
+
+MutationLog::MutationLog(const std::string& path)
+    : path_(path) {
+    const std::string data = ReadFile(path);
+    const size_t valid_size = ForEachRecord(data, [](std::string_view) {});
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot open mutation log "s + path);
+    }
+    if (valid_size < data.size() && ftruncate(fd_, static_cast<off_t>(valid_size)) != 0) {
+        close(fd_);
+        throw std::runtime_error("Cannot truncate mutation log "s + path);
+    }
+    durable_size_ = valid_size;
+}
+
+MutationLog::~MutationLog() {
+    if (!failed_ && !pending_.empty()) {
+        [[maybe_unused]] const ssize_t written = write(fd_, pending_.data(), pending_.size());
+    }
+    close(fd_);
+}
+
+uint64_t MutationLog::AddDocument(SearchServer& server, int document_id, std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    server.CheckNewDocument(document_id, document);
+
+    std::string payload;
+    payload.reserve(4 * sizeof(uint32_t) + ratings.size() * sizeof(int32_t) + document.size() + 1);
+    AppendValue(payload, RecordType::ADD_DOCUMENT);
+    AppendValue(payload, static_cast<int32_t>(document_id));
+    AppendValue(payload, static_cast<int32_t>(status));
+    AppendValue(payload, static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        AppendValue(payload, static_cast<int32_t>(rating));
+    }
+    AppendValue(payload, static_cast<uint32_t>(document.size()));
+    payload += document;
+    const uint64_t sequence_number = Append(payload);
+    server.AddDocument(document_id, document, status, ratings);
+    return sequence_number;
+}
+
+uint64_t MutationLog::RemoveDocument(SearchServer& server, int document_id) {
+    std::string payload;
+    AppendValue(payload, RecordType::REMOVE_DOCUMENT);
+    AppendValue(payload, static_cast<int32_t>(document_id));
+    const uint64_t sequence_number = Append(payload);
+    server.RemoveDocument(document_id);
+    return sequence_number;
+}
+
+void MutationLog::CheckNotFailed() const {
+    if (failed_) {
+        throw std::runtime_error("Mutation log "s + path_ + " failed"s);
+    }
+}
+
+uint64_t MutationLog::Append(const std::string& payload) {
+    std::lock_guard lock(mutex_);
+    CheckNotFailed();
+    AppendValue(pending_, static_cast<uint32_t>(payload.size()));
+    AppendValue(pending_, ComputeCrc32(payload));
+    pending_ += payload;
+    return ++last_sequence_number_;
+}
+
+void MutationLog::Commit(uint64_t sequence_number) {
+    std::unique_lock lock(mutex_);
+    while (durable_sequence_number_ < sequence_number) {
+        CheckNotFailed();
+        if (syncing_) {
+            synced_.wait(lock);
+            continue;
+        }
+
+        // This caller leads the group: everything queued so far goes out in one write
+        syncing_ = true;
+        std::string batch;
+        batch.swap(pending_);
+        const uint64_t batch_sequence_number = last_sequence_number_;
+        lock.unlock();
+        try {
+            WriteBatch(batch);
+        }
+        catch (...) {
+            lock.lock();
+            // Bytes of the batch that did reach the file are cut off, so the retry continues the valid
+            // records; records stay queued in order for the next attempt
+            if (ftruncate(fd_, static_cast<off_t>(durable_size_)) != 0) {
+                failed_ = true;
+            }
+            pending_.insert(0, batch);
+            syncing_ = false;
+            synced_.notify_all();
+            throw;
+        }
+        lock.lock();
+        durable_sequence_number_ = batch_sequence_number;
+        durable_size_ += batch.size();
+        syncing_ = false;
+        synced_.notify_all();
+    }
+}
+
+void MutationLog::Sync() {
+    uint64_t sequence_number;
+    {
+        std::lock_guard lock(mutex_);
+        sequence_number = last_sequence_number_;
+    }
+    Commit(sequence_number);
+}
+
+void MutationLog::WriteBatch(const std::string& batch) {
+    size_t written = 0;
+    while (written < batch.size()) {
+        const ssize_t result = write(fd_, batch.data() + written, batch.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Cannot write mutation log "s + path_);
+        }
+        written += static_cast<size_t>(result);
+    }
+    if (fdatasync(fd_) != 0) {
+        throw std::runtime_error("Cannot sync mutation log "s + path_);
+    }
+}
+
+void MutationLog::Checkpoint(const SearchServer& server, const std::string& snapshot_path) {
+    Sync();
+    const std::string temporary_path = snapshot_path + ".tmp"s;
+    server.SaveSnapshot(temporary_path);
+    {
+        const int fd = open(temporary_path.c_str(), O_RDONLY);
+        if (fd < 0 || fsync(fd) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Cannot sync snapshot "s + temporary_path);
+        }
+        close(fd);
+    }
+    if (std::rename(temporary_path.c_str(), snapshot_path.c_str()) != 0) {
+        throw std::runtime_error("Cannot replace snapshot "s + snapshot_path);
+    }
+    SyncDirectory(snapshot_path);
+
+    // A crash before the log is emptied replays records the snapshot already has, which is harmless
+    std::lock_guard lock(mutex_);
+    if (ftruncate(fd_, 0) != 0 || fdatasync(fd_) != 0) {
+        throw std::runtime_error("Cannot truncate mutation log "s + path_);
+    }
+    durable_size_ = 0;
+}
+
+size_t MutationLog::Replay(const std::string& path, SearchServer& server) {
+    const std::string data = ReadFile(path);
+    size_t record_count = 0;
+    ForEachRecord(data, [&server, &record_count](std::string_view payload) {
+        PayloadReader reader(payload);
+        const auto type = reader.ReadValue<RecordType>();
+        const int document_id = reader.ReadValue<int32_t>();
+        if (type == RecordType::ADD_DOCUMENT) {
+            const auto status = static_cast<DocumentStatus>(reader.ReadValue<int32_t>());
+            std::vector<int> ratings(reader.ReadValue<uint32_t>());
+            for (int& rating : ratings) {
+                rating = reader.ReadValue<int32_t>();
+            }
+            const std::string_view document = reader.ReadBytes(reader.ReadValue<uint32_t>());
+            if (!server.HasDocument(document_id)) {
+                server.AddDocument(document_id, document, status, ratings);
+            }
+        }
+        else if (type == RecordType::REMOVE_DOCUMENT) {
+            server.RemoveDocument(document_id);
+        }
+        else {
+            throw std::runtime_error("Mutation log record is corrupted"s);
+        }
+        ++record_count;
+        });
+    return record_count;
+}
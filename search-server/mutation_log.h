@@ -0,0 +1,73 @@
+#pragma once
+#include "document.h"
+#include "search_server.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Append-only log of index mutations for recovery between snapshots. Every record carries
+// a CRC32, so a record torn by a crash is detected and dropped.
+//
+// AddDocument and RemoveDocument queue the record of a mutation, then apply it to the server,
+// and return the record sequence number. They must be serialized like any other server write.
+// Commit makes the record durable and may be called outside the lock that guards the server:
+// concurrent callers are grouped, so one write and fdatasync covers every record queued meanwhile.
+// A failed write is cut off the file and retried by the next Commit; if even that fails the log
+// refuses every later call, as records appended after torn bytes could never be replayed
+class MutationLog {
+public:
+    // Opens or creates the log. A partial record left at the end by a crash is cut off
+    explicit MutationLog(const std::string& path);
+    MutationLog(const MutationLog&) = delete;
+    MutationLog& operator=(const MutationLog&) = delete;
+    // Writes queued records without waiting for them to reach the disk
+    ~MutationLog();
+
+    // Nothing is logged if the server rejects the mutation. If applying a logged mutation throws,
+    // the record stays queued and replay applies it
+    uint64_t AddDocument(SearchServer& server, int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+    uint64_t RemoveDocument(SearchServer& server, int document_id);
+
+    // Blocks until the record with this sequence number and all earlier ones are on disk
+    void Commit(uint64_t sequence_number);
+    // Commits every queued record
+    void Sync();
+
+    // Saves a snapshot of the server, replacing snapshot_path atomically, and empties the log.
+    // No mutation may run concurrently
+    void Checkpoint(const SearchServer& server, const std::string& snapshot_path);
+
+    // Applies the valid records of the log at path to a server restored from the last snapshot.
+    // Replay is idempotent for records the snapshot already contains: adding a present id is
+    // skipped and removing an absent one does nothing. Returns the number of records read
+    static size_t Replay(const std::string& path, SearchServer& server);
+
+private:
+    enum class RecordType : uint8_t {
+        ADD_DOCUMENT = 1,
+        REMOVE_DOCUMENT = 2,
+    };
+
+    uint64_t Append(const std::string& payload);
+    void WriteBatch(const std::string& batch);
+    void CheckNotFailed() const;
+
+    int fd_ = -1;
+    std::mutex mutex_;
+    std::condition_variable synced_;
+    // Encoded records not yet handed to the file
+    std::string pending_;
+    uint64_t last_sequence_number_ = 0;
+    uint64_t durable_sequence_number_ = 0;
+    // File size covering the durable records, torn writes are truncated back to it
+    uint64_t durable_size_ = 0;
+    // Set when a torn write could not be truncated
+    bool failed_ = false;
+    // Set while one of the committers writes a batch, the others wait for it
+    bool syncing_ = false;
+    std::string path_;
+};
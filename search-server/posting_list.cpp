@@ -0,0 +1,308 @@
+#include "posting_list.h"
+#include <array>
+
+// The SSSE3 decoder is compiled for x86 whatever the target flags are and picked at run time,
+// so a plain -O2 build still decodes with vector shuffles on CPUs that have them
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POSTING_LIST_SSSE3_DECODE
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Decoding loads 16 bytes at the start of every group of four values
+const size_t DATA_PADDING = 16;
+
+// Lists are many and most stop growing at some point, so they grow by a quarter instead of doubling
+void ReserveBytes(std::vector<uint8_t>& bytes, size_t extra) {
+    if (bytes.size() + extra > bytes.capacity()) {
+        bytes.reserve(std::max(bytes.size() + extra, bytes.size() + bytes.size() / 4));
+    }
+}
+
+// VByte: seven bits per byte, the high bit marks that more bytes follow
+void AppendVarint(uint32_t value, std::vector<uint8_t>& bytes) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+const uint8_t* ReadVarint(const uint8_t* bytes, uint32_t& value) {
+    value = 0;
+    for (int shift = 0;; shift += 7) {
+        value |= static_cast<uint32_t>(*bytes & 0x7F) << shift;
+        if (!(*bytes++ & 0x80)) {
+            return bytes;
+        }
+    }
+}
+
+// StreamVByte: a control byte holds the byte lengths of four values as 2-bit codes,
+// the values follow in little-endian order using only their significant bytes
+void EncodeStream(const uint32_t* values, size_t count, std::vector<uint8_t>& data) {
+    const size_t control_offset = data.size();
+    ReserveBytes(data, (count + 3) / 4 + count * sizeof(uint32_t));
+    data.resize(data.size() + (count + 3) / 4, 0);
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t value = values[i];
+        const uint32_t code = value < (1u << 8) ? 0 : value < (1u << 16) ? 1 : value < (1u << 24) ? 2 : 3;
+        data[control_offset + i / 4] |= static_cast<uint8_t>(code << (2 * (i % 4)));
+        for (uint32_t byte = 0; byte <= code; ++byte) {
+            data.push_back(static_cast<uint8_t>(value >> (8 * byte)));
+        }
+    }
+}
+
+#if defined(POSTING_LIST_SSSE3_DECODE)
+struct DecodeTables {
+    std::array<std::array<uint8_t, 16>, 256> shuffles;
+    std::array<uint8_t, 256> lengths;
+
+    DecodeTables() {
+        for (int control = 0; control < 256; ++control) {
+            uint8_t offset = 0;
+            for (int lane = 0; lane < 4; ++lane) {
+                const int length = ((control >> (2 * lane)) & 3) + 1;
+                for (int byte = 0; byte < 4; ++byte) {
+                    // Indexes with the high bit set make the shuffle write zero
+                    shuffles[control][lane * 4 + byte] = byte < length ? offset + byte : 0x80;
+                }
+                offset += length;
+            }
+            lengths[control] = offset;
+        }
+    }
+};
+
+const DecodeTables& GetDecodeTables() {
+    static const DecodeTables tables;
+    return tables;
+}
+
+bool CanDecodeWithSsse3() {
+#if defined(__SSSE3__)
+    return true;
+#else
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+#endif
+}
+
+template <bool IS_DELTA>
+__attribute__((target("ssse3")))
+const uint8_t* DecodeStreamSsse3(const uint8_t* control, uint32_t* values, uint32_t prefix_base) {
+    const DecodeTables& tables = GetDecodeTables();
+    const uint8_t* data = control + PostingList::BLOCK_SIZE / 4;
+    __m128i previous = _mm_set1_epi32(static_cast<int>(prefix_base));
+    for (size_t group = 0; group < PostingList::BLOCK_SIZE / 4; ++group) {
+        const uint8_t code = control[group];
+        const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tables.shuffles[code].data()));
+        __m128i decoded = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), shuffle);
+        if constexpr (IS_DELTA) {
+            decoded = _mm_add_epi32(decoded, _mm_slli_si128(decoded, 4));
+            decoded = _mm_add_epi32(decoded, _mm_slli_si128(decoded, 8));
+            decoded = _mm_add_epi32(decoded, previous);
+            previous = _mm_shuffle_epi32(decoded, 0xFF);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + group * 4), decoded);
+        data += tables.lengths[code];
+    }
+    return data;
+}
+#endif
+
+template <bool IS_DELTA>
+const uint8_t* DecodeStreamScalar(const uint8_t* control, uint32_t* values, uint32_t prefix_base) {
+    const uint8_t* data = control + PostingList::BLOCK_SIZE / 4;
+    uint32_t previous = prefix_base;
+    for (size_t i = 0; i < PostingList::BLOCK_SIZE; ++i) {
+        const int length = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+        uint32_t value = 0;
+        for (int byte = 0; byte < length; ++byte) {
+            value |= static_cast<uint32_t>(data[byte]) << (8 * byte);
+        }
+        data += length;
+        if constexpr (IS_DELTA) {
+            previous += value;
+            value = previous;
+        }
+        values[i] = value;
+    }
+    return data;
+}
+
+// Decodes BLOCK_SIZE values and returns the end of their bytes. With IS_DELTA the values
+// are deltas and are turned into a running sum starting from prefix_base
+template <bool IS_DELTA>
+const uint8_t* DecodeStream(const uint8_t* control, uint32_t* values, uint32_t prefix_base) {
+#if defined(POSTING_LIST_SSSE3_DECODE)
+    if (CanDecodeWithSsse3()) {
+        return DecodeStreamSsse3<IS_DELTA>(control, values, prefix_base);
+    }
+#endif
+    return DecodeStreamScalar<IS_DELTA>(control, values, prefix_base);
+}
+
+}
+
+void PostingList::Add(int document_id, uint32_t term_count, double term_freq) {
+    // Documents arrive with growing ids, so appending is the common case
+    if (Size() > 0 && document_id <= GetLastDocumentId()) {
+        AddUnordered(document_id, term_count, term_freq);
+        return;
+    }
+
+    const int previous_id = tail_size_ > 0 ? tail_last_document_id_ : blocks_.empty() ? 0 : blocks_.back().last_document_id;
+    ReserveBytes(tail_, 10);
+    AppendVarint(static_cast<uint32_t>(document_id - previous_id), tail_);
+    AppendVarint(term_count, tail_);
+    tail_last_document_id_ = document_id;
+    ++tail_size_;
+    max_term_freq_ = std::max(max_term_freq_, term_freq);
+    if (tail_size_ == BLOCK_SIZE) {
+        SealTail();
+    }
+}
+
+// Rare path: the list is decoded, changed and encoded again
+void PostingList::AddUnordered(int document_id, uint32_t term_count, double term_freq) {
+    std::vector<int> document_ids;
+    std::vector<uint32_t> term_counts;
+    document_ids.reserve(Size() + 1);
+    term_counts.reserve(Size() + 1);
+    ForEach([&](int id, uint32_t count) {
+        document_ids.push_back(id);
+        term_counts.push_back(count);
+        });
+
+    const auto it = std::lower_bound(document_ids.begin(), document_ids.end(), document_id);
+    const auto pos = it - document_ids.begin();
+    if (it != document_ids.end() && *it == document_id) {
+        // Both counts belong to the same document, so they share its length
+        term_freq *= static_cast<double>(term_counts[pos] + term_count) / term_count;
+        term_counts[pos] += term_count;
+    }
+    else {
+        document_ids.insert(it, document_id);
+        term_counts.insert(term_counts.begin() + pos, term_count);
+    }
+
+    const double max_term_freq = std::max(max_term_freq_, term_freq);
+    *this = PostingList();
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        Add(document_ids[i], term_counts[i], 0.0);
+    }
+    max_term_freq_ = max_term_freq;
+}
+
+void PostingList::SealTail() {
+    int document_ids[BLOCK_SIZE];
+    uint32_t values[BLOCK_SIZE];
+    DecodeTail(document_ids, values);
+
+    if (data_.size() >= DATA_PADDING) {
+        data_.resize(data_.size() - DATA_PADDING);
+    }
+    const size_t offset = data_.size();
+    uint32_t deltas[BLOCK_SIZE];
+    int previous_id = blocks_.empty() ? 0 : blocks_.back().last_document_id;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        deltas[i] = static_cast<uint32_t>(document_ids[i] - previous_id);
+        previous_id = document_ids[i];
+    }
+    EncodeStream(deltas, BLOCK_SIZE, data_);
+    EncodeStream(values, BLOCK_SIZE, data_);
+    ReserveBytes(data_, DATA_PADDING);
+    data_.resize(data_.size() + DATA_PADDING, 0);
+
+    blocks_.push_back({ document_ids[BLOCK_SIZE - 1], static_cast<uint32_t>(offset) });
+    tail_.clear();
+    tail_size_ = 0;
+}
+
+void PostingList::DecodeBlock(size_t block, int* document_ids, uint32_t* term_counts) const {
+    const uint32_t base = block == 0 ? 0 : static_cast<uint32_t>(blocks_[block - 1].last_document_id);
+    const uint8_t* counts = DecodeStream<true>(data_.data() + blocks_[block].offset, reinterpret_cast<uint32_t*>(document_ids), base);
+    DecodeStream<false>(counts, term_counts, 0);
+}
+
+size_t PostingList::DecodeTail(int* document_ids, uint32_t* term_counts) const {
+    const uint8_t* bytes = tail_.data();
+    uint32_t document_id = blocks_.empty() ? 0 : static_cast<uint32_t>(blocks_.back().last_document_id);
+    for (size_t i = 0; i < tail_size_; ++i) {
+        uint32_t delta = 0;
+        bytes = ReadVarint(bytes, delta);
+        document_id += delta;
+        document_ids[i] = static_cast<int>(document_id);
+        bytes = ReadVarint(bytes, term_counts[i]);
+    }
+    return tail_size_;
+}
+
+size_t PostingList::GetBlockCount() const {
+    return blocks_.size();
+}
+
+size_t PostingList::FindBlock(int document_id) const {
+    return std::lower_bound(blocks_.begin(), blocks_.end(), document_id, [](const Block& block, int document_id) {
+        return block.last_document_id < document_id;
+        }) - blocks_.begin();
+}
+
+int PostingList::GetLastDocumentId() const {
+    return tail_size_ > 0 ? tail_last_document_id_ : blocks_.back().last_document_id;
+}
+
+size_t PostingList::Size() const {
+    return GetBlockCount() * BLOCK_SIZE + tail_size_;
+}
+
+bool PostingList::Empty() const {
+    return Size() == 0;
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    return sizeof(*this) + blocks_.capacity() * sizeof(Block) + data_.capacity() + tail_.capacity();
+}
+
+PostingList::Cursor::Cursor(const PostingList& postings, int first_document_id, int last_document_id)
+    : postings_(&postings)
+    , last_document_id_(last_document_id) {
+    LoadBlock(postings.FindBlock(first_document_id));
+    SeekTo(first_document_id);
+}
+
+void PostingList::Cursor::LoadBlock(size_t block) {
+    block_ = block;
+    pos_ = 0;
+    if (block < postings_->GetBlockCount()) {
+        postings_->DecodeBlock(block, document_ids_, term_counts_);
+        count_ = BLOCK_SIZE;
+    }
+    else if (block == postings_->GetBlockCount()) {
+        count_ = postings_->DecodeTail(document_ids_, term_counts_);
+    }
+    else {
+        count_ = 0;
+    }
+    UpdateDocumentId();
+}
+
+bool PostingList::Cursor::SeekTo(int document_id) {
+    if (pos_ >= count_ || document_id_ >= document_id) {
+        return document_id_ == document_id;
+    }
+    if (document_ids_[count_ - 1] < document_id && block_ < postings_->GetBlockCount()) {
+        // Blocks whose last id is below document_id are skipped without decoding
+        LoadBlock(std::max(block_ + 1, postings_->FindBlock(document_id)));
+    }
+    pos_ = std::lower_bound(document_ids_ + pos_, document_ids_ + count_, document_id) - document_ids_;
+    UpdateDocumentId();
+    return document_id_ == document_id;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Posting list of a single term: ascending document ids, each with the number of times the term
+// occurs in the document. Full blocks of BLOCK_SIZE postings are stored as StreamVByte-coded id
+// deltas and counts, which decode with vector shuffles; the postings after the last full block
+// are VByte-coded pairs that can be appended in place. A typical posting takes 2-3 bytes
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    class Cursor;
+
+    // term_freq is term_count divided by the document length, it only maintains the score bound
+    void Add(int document_id, uint32_t term_count, double term_freq);
+
+    size_t Size() const;
+    bool Empty() const;
+    // Upper bound of the term frequencies, used to prune documents during top-k search
+    double GetMaxTermFreq() const;
+    // Bytes held by the list, including unused capacity
+    size_t GetMemoryUsage() const;
+
+    // Calls callback(document_id, term_count) for the postings with ids in [first_document_id, last_document_id)
+    template <typename Callback>
+    void ForEach(int first_document_id, int last_document_id, Callback callback) const;
+    template <typename Callback>
+    void ForEach(Callback callback) const;
+
+private:
+    // Last id lets whole blocks be skipped without decoding them
+    struct Block {
+        int last_document_id;
+        uint32_t offset;
+    };
+
+    size_t GetBlockCount() const;
+    // First block whose last id is not less than document_id, GetBlockCount() if there is none
+    size_t FindBlock(int document_id) const;
+    int GetLastDocumentId() const;
+    void DecodeBlock(size_t block, int* document_ids, uint32_t* term_counts) const;
+    // Returns the number of tail postings
+    size_t DecodeTail(int* document_ids, uint32_t* term_counts) const;
+    void SealTail();
+    void AddUnordered(int document_id, uint32_t term_count, double term_freq);
+
+    std::vector<Block> blocks_;
+    // Encoded blocks followed by padding, so that vector loads never read past the buffer
+    std::vector<uint8_t> data_;
+    std::vector<uint8_t> tail_;
+    int tail_last_document_id_ = 0;
+    uint32_t tail_size_ = 0;
+    double max_term_freq_ = 0.0;
+};
+
+// Forward iterator over the postings of a document id range. It decodes one block at a time
+// and skips whole blocks when seeking
+class PostingList::Cursor {
+public:
+    Cursor(const PostingList& postings, int first_document_id, int last_document_id);
+
+    // Id of the current posting, last_document_id of the range once it is exhausted
+    int GetDocumentId() const {
+        return document_id_;
+    }
+
+    uint32_t GetTermCount() const {
+        return term_counts_[pos_];
+    }
+
+    void Next() {
+        if (++pos_ == count_) {
+            LoadBlock(block_ + 1);
+        }
+        else {
+            UpdateDocumentId();
+        }
+    }
+
+    // Moves to the first posting with id not less than document_id, returns true if it is exactly document_id
+    bool SeekTo(int document_id);
+
+private:
+    void LoadBlock(size_t block);
+
+    void UpdateDocumentId() {
+        document_id_ = pos_ < count_ ? std::min(document_ids_[pos_], last_document_id_) : last_document_id_;
+    }
+
+    const PostingList* postings_;
+    int last_document_id_;
+    int document_id_ = 0;
+    // Block index GetBlockCount() stands for the plain tail
+    size_t block_ = 0;
+    size_t pos_ = 0;
+    size_t count_ = 0;
+    int document_ids_[BLOCK_SIZE];
+    uint32_t term_counts_[BLOCK_SIZE];
+};
+
+template <typename Callback>
+void PostingList::ForEach(int first_document_id, int last_document_id, Callback callback) const {
+    int document_ids[BLOCK_SIZE];
+    uint32_t term_counts[BLOCK_SIZE];
+    for (size_t block = FindBlock(first_document_id); block < GetBlockCount(); ++block) {
+        DecodeBlock(block, document_ids, term_counts);
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+            if (document_ids[i] >= last_document_id) {
+                return;
+            }
+            if (document_ids[i] >= first_document_id) {
+                callback(document_ids[i], term_counts[i]);
+            }
+        }
+    }
+    const size_t tail_size = DecodeTail(document_ids, term_counts);
+    for (size_t i = 0; i < tail_size && document_ids[i] < last_document_id; ++i) {
+        if (document_ids[i] >= first_document_id) {
+            callback(document_ids[i], term_counts[i]);
+        }
+    }
+}
+
+template <typename Callback>
+void PostingList::ForEach(Callback callback) const {
+    ForEach(0, std::numeric_limits<int>::max(), callback);
+}
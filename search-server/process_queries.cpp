@@ -6,21 +6,53 @@ using namespace std;
 
 //         .        result
 vector<vector<Document>> ProcessQueries(
+    QueryExecutor& executor,
     const SearchServer& search_server,
     const vector<string>& queries) {
     vector<vector<Document>> result(queries.size());
-    transform(execution::par_unseq, queries.begin(), queries.end(), result.begin(),
-        [&search_server](const auto& query) { return search_server.FindTopDocuments(query); });
+    // Every query runs sequentially inside its worker, parallelism comes only from the executor
+    executor.ParallelFor(queries.size(), [&](size_t index, size_t) {
+        result[index] = search_server.FindTopDocuments(execution::seq, queries[index]);
+        });
     return result;
 }
 
+vector<vector<Document>> ProcessQueries(
+    const SearchServer& search_server,
+    const vector<string>& queries) {
+    return ProcessQueries(QueryExecutor::GetDefault(), search_server, queries);
+}
+
 //     .        (ProcessQueriss) documents
-std::vector<Document> ProcessQueriesJoined(
-    const SearchServer& search_server, const std::vector<std::string>& queries) {
-    std::vector<std::vector<Document>> documents_lists = ProcessQueries(search_server, queries);
-    std::vector<Document> documents;
-    for (auto& docs : documents_lists) {
-        documents.insert(documents.end(), docs.begin(), docs.end());
+JoinedQueryResults ProcessQueriesJoined(
+    QueryExecutor& executor, const SearchServer& search_server, const std::vector<std::string>& queries) {
+    // Every query writes its results straight into its own slot of MAX_RESULT_DOCUMENT_COUNT documents,
+    // then the slots are moved together in one pass
+    const size_t slot_size = MAX_RESULT_DOCUMENT_COUNT;
+    JoinedQueryResults results;
+    results.documents.resize(queries.size() * slot_size);
+    std::vector<size_t> counts(queries.size());
+    executor.ParallelFor(queries.size(), [&](size_t index, size_t) {
+        counts[index] = search_server.FindTopDocumentsInto(execution::seq, queries[index], DocumentStatus::ACTUAL,
+            results.documents.data() + index * slot_size);
+        });
+
+    results.offsets.reserve(queries.size() + 1);
+    results.offsets.push_back(0);
+    for (size_t index = 0; index < queries.size(); ++index) {
+        const size_t offset = results.offsets.back();
+        const auto slot = results.documents.begin() + index * slot_size;
+        // A slot never starts before its offset, so the move goes to the left or nowhere
+        if (offset != index * slot_size) {
+            std::move(slot, slot + counts[index], results.documents.begin() + offset);
+        }
+        results.offsets.push_back(offset + counts[index]);
     }
-    return documents;
-}
\ No newline at end of file
+    results.documents.resize(results.offsets.back());
+    return results;
+}
+
+JoinedQueryResults ProcessQueriesJoined(
+    const SearchServer& search_server, const std::vector<std::string>& queries) {
+    return ProcessQueriesJoined(QueryExecutor::GetDefault(), search_server, queries);
+}
@@ -1,11 +1,35 @@
 #pragma once
 #include "document.h"
+#include "query_executor.h"
 #include "search_server.h"
 #include <string>
 #include <vector>
 
+// Results of several queries in one buffer, documents of query i are [offsets[i], offsets[i + 1])
+struct JoinedQueryResults {
+    std::vector<Document> documents;
+    std::vector<size_t> offsets;
+
+    std::vector<Document>::const_iterator begin() const {
+        return documents.begin();
+    }
+
+    std::vector<Document>::const_iterator end() const {
+        return documents.end();
+    }
+
+    size_t size() const {
+        return documents.size();
+    }
+};
+
+std::vector<std::vector<Document>> ProcessQueries(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
-std::vector<Document>ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
+JoinedQueryResults ProcessQueriesJoined(QueryExecutor& executor, const SearchServer& search_server, const std::vector<std::string>& queries);
+JoinedQueryResults ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
@@ -0,0 +1,56 @@
+#include "query_arena.h"
+#include <algorithm>
+
+QueryArena& QueryArena::ForCurrentThread() {
+    thread_local QueryArena arena;
+    return arena;
+}
+
+QueryArena::Scope::Scope(QueryArena& arena)
+    : arena_(arena) {
+    arena_.Begin();
+}
+
+QueryArena::Scope::~Scope() {
+    arena_.End();
+}
+
+std::pmr::memory_resource* QueryArena::Scope::GetResource() const {
+    return &*arena_.resource_;
+}
+
+size_t QueryArena::GetCapacity() const {
+    return capacity_;
+}
+
+void QueryArena::Begin() {
+    if (depth_++ > 0) {
+        return;
+    }
+    // Grown only between queries, when nothing points into the old buffer
+    if (capacity_ == 0 || overflow_.allocated_bytes > 0) {
+        capacity_ = std::max(INITIAL_CAPACITY, capacity_ + overflow_.allocated_bytes);
+        buffer_.reset(new std::byte[capacity_]);
+    }
+    overflow_.allocated_bytes = 0;
+    resource_.emplace(buffer_.get(), capacity_, &overflow_);
+}
+
+void QueryArena::End() {
+    if (--depth_ == 0) {
+        resource_.reset();
+    }
+}
+
+void* QueryArena::OverflowResource::do_allocate(size_t bytes, size_t alignment) {
+    allocated_bytes += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void QueryArena::OverflowResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool QueryArena::OverflowResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+// Scratch memory for the temporary containers of a query. Allocations are bump-pointer
+// from a buffer kept between queries; memory a query needs beyond it comes from the heap
+// and the buffer grows to cover it, so a thread stops allocating once it has seen its largest query
+class QueryArena {
+public:
+    // Arena owned by the calling thread
+    static QueryArena& ForCurrentThread();
+
+    // Memory of the queries running on the thread, released when the outermost scope ends.
+    // Nested scopes, e.g. a search block stolen by a thread waiting in its own search, share it
+    class Scope {
+    public:
+        explicit Scope(QueryArena& arena);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        std::pmr::memory_resource* GetResource() const;
+
+    private:
+        QueryArena& arena_;
+    };
+
+    size_t GetCapacity() const;
+
+private:
+    static constexpr size_t INITIAL_CAPACITY = 16 * 1024;
+
+    // Heap fallback which remembers how much the current query took from it
+    class OverflowResource : public std::pmr::memory_resource {
+    public:
+        size_t allocated_bytes = 0;
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    };
+
+    void Begin();
+    void End();
+
+    std::unique_ptr<std::byte[]> buffer_;
+    size_t capacity_ = 0;
+    OverflowResource overflow_;
+    std::optional<std::pmr::monotonic_buffer_resource> resource_;
+    int depth_ = 0;
+};
@@ -0,0 +1,166 @@
+#include "query_executor.h"
+#include <utility>
+
+namespace {
+
+// Executor whose task the current thread is running, and the worker it runs it as
+thread_local const QueryExecutor* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+}
+
+QueryExecutor::QueryExecutor(size_t worker_count)
+    : ranges_(std::max<size_t>(worker_count, 1)) {
+    for (size_t worker = 1; worker < ranges_.size(); ++worker) {
+        threads_.emplace_back([this, worker] {
+            WorkerLoop(worker);
+            });
+    }
+}
+
+QueryExecutor::~QueryExecutor() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    job_ready_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+QueryExecutor& QueryExecutor::GetDefault() {
+    static QueryExecutor executor;
+    return executor;
+}
+
+size_t QueryExecutor::GetWorkerCount() const {
+    return ranges_.size();
+}
+
+void QueryExecutor::Run(size_t count, void* task, TaskInvoker invoker) {
+    if (count == 0) {
+        return;
+    }
+    if (current_executor == this) {
+        RunInline(count, task, invoker, current_worker);
+        return;
+    }
+    std::lock_guard run_lock(run_mutex_);
+    const size_t worker_count = ranges_.size();
+    for (size_t worker = 0; worker < worker_count; ++worker) {
+        std::lock_guard range_lock(ranges_[worker].mutex);
+        ranges_[worker].begin = count * worker / worker_count;
+        ranges_[worker].end = count * (worker + 1) / worker_count;
+    }
+    {
+        std::lock_guard lock(mutex_);
+        task_ = task;
+        invoker_ = invoker;
+        error_ = nullptr;
+        failed_.store(false, std::memory_order_relaxed);
+        busy_workers_ = worker_count - 1;
+        ++job_generation_;
+    }
+    job_ready_.notify_all();
+
+    RunWorker(0);
+
+    std::unique_lock lock(mutex_);
+    job_done_.wait(lock, [this] {
+        return busy_workers_ == 0;
+        });
+    task_ = nullptr;
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void QueryExecutor::RunInline(size_t count, void* task, TaskInvoker invoker, size_t worker) {
+    for (size_t index = 0; index < count; ++index) {
+        invoker(task, index, worker);
+    }
+}
+
+void QueryExecutor::WorkerLoop(size_t worker) {
+    uint64_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            job_ready_.wait(lock, [this, seen_generation] {
+                return stopping_ || job_generation_ != seen_generation;
+                });
+            if (stopping_) {
+                return;
+            }
+            seen_generation = job_generation_;
+        }
+        RunWorker(worker);
+        {
+            std::lock_guard lock(mutex_);
+            --busy_workers_;
+        }
+        job_done_.notify_one();
+    }
+}
+
+void QueryExecutor::RunWorker(size_t worker) {
+    const QueryExecutor* const outer_executor = std::exchange(current_executor, this);
+    const size_t outer_worker = std::exchange(current_worker, worker);
+    size_t index;
+    while (TakeIndex(worker, index)) {
+        try {
+            invoker_(task_, index, worker);
+        }
+        catch (...) {
+            std::lock_guard lock(mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+            failed_.store(true, std::memory_order_relaxed);
+        }
+    }
+    // A task of another executor may have called this one
+    current_executor = outer_executor;
+    current_worker = outer_worker;
+}
+
+bool QueryExecutor::TakeIndex(size_t worker, size_t& index) {
+    if (failed_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    {
+        std::lock_guard lock(ranges_[worker].mutex);
+        WorkRange& range = ranges_[worker];
+        if (range.begin < range.end) {
+            index = range.begin++;
+            return true;
+        }
+    }
+    return StealRange(worker, index);
+}
+
+bool QueryExecutor::StealRange(size_t worker, size_t& index) {
+    const size_t worker_count = ranges_.size();
+    for (size_t offset = 1; offset < worker_count; ++offset) {
+        WorkRange& victim = ranges_[(worker + offset) % worker_count];
+        size_t begin;
+        size_t end;
+        {
+            std::lock_guard lock(victim.mutex);
+            if (victim.begin >= victim.end) {
+                continue;
+            }
+            // The victim keeps the lower half, which it is about to reach anyway
+            begin = victim.begin + (victim.end - victim.begin) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+        std::lock_guard lock(ranges_[worker].mutex);
+        ranges_[worker].begin = begin + 1;
+        ranges_[worker].end = end;
+        index = begin;
+        return true;
+    }
+    return false;
+}
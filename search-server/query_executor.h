@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of workers for running independent queries. ParallelFor gives every worker a contiguous
+// range of indexes; a worker that runs out steals half of the remaining range of another one.
+// Workers live as long as the executor, so their thread-local scratch buffers are reused across calls
+class QueryExecutor {
+public:
+    explicit QueryExecutor(size_t worker_count = std::max(1u, std::thread::hardware_concurrency()));
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+    ~QueryExecutor();
+
+    // Shared executor with a worker per hardware thread
+    static QueryExecutor& GetDefault();
+
+    size_t GetWorkerCount() const;
+
+    // Calls task(index, worker) for every index in [0, count) and waits for all of them. The calling
+    // thread is worker 0. Calls from several threads run one after another. A call from inside a task
+    // of the same executor runs all of its indexes inline on the calling worker, as the other workers
+    // are busy with the outer call. A call that comes back through the workers of another executor
+    // is not detected and waits forever. If a task throws, the remaining indexes are skipped and the first
+    // exception is rethrown
+    template <typename Task>
+    void ParallelFor(size_t count, Task task) {
+        Run(count, &task, [](void* task, size_t index, size_t worker) {
+            (*static_cast<Task*>(task))(index, worker);
+            });
+    }
+
+private:
+    using TaskInvoker = void (*)(void* task, size_t index, size_t worker);
+
+    struct alignas(64) WorkRange {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    void Run(size_t count, void* task, TaskInvoker invoker);
+    void RunInline(size_t count, void* task, TaskInvoker invoker, size_t worker);
+    void RunWorker(size_t worker);
+    bool TakeIndex(size_t worker, size_t& index);
+    bool StealRange(size_t worker, size_t& index);
+    void WorkerLoop(size_t worker);
+
+    std::vector<WorkRange> ranges_;
+    std::vector<std::thread> threads_;
+
+    // Serializes ParallelFor calls
+    std::mutex run_mutex_;
+    // Guards the job description and the counters below
+    std::mutex mutex_;
+    std::condition_variable job_ready_;
+    std::condition_variable job_done_;
+    uint64_t job_generation_ = 0;
+    size_t busy_workers_ = 0;
+    bool stopping_ = false;
+    void* task_ = nullptr;
+    TaskInvoker invoker_ = nullptr;
+    std::exception_ptr error_;
+    // Checked before every index, so it is not under mutex_
+    std::atomic<bool> failed_ = false;
+};
@@ -0,0 +1,92 @@
+#include "query_result_cache.h"
+#include <algorithm>
+#include <functional>
+
+QueryResultCache::QueryResultCache(size_t capacity, size_t shard_count)
+    : shards_(std::max<size_t>(shard_count, 1)) {
+    shard_capacity_ = std::max<size_t>((capacity + shards_.size() - 1) / shards_.size(), 1);
+}
+
+std::vector<Document> QueryResultCache::FindTopDocuments(const SearchServer& search_server, std::string_view raw_query,
+    DocumentStatus status) {
+    // Invalid queries throw here, before anything is counted
+    std::string key = search_server.GetCanonicalQuery(raw_query);
+    key += '\0';
+    key += std::to_string(static_cast<int>(status));
+
+    std::vector<Document> documents;
+    if (FindEntry(key, search_server, documents)) {
+        return documents;
+    }
+    // Searched without holding the shard, concurrent misses of one key may both compute it
+    const uint64_t generation = search_server.GetGeneration();
+    documents = search_server.FindTopDocuments(raw_query, status);
+    StoreEntry(std::move(key), { search_server.GetInstanceId(), generation, documents });
+    return documents;
+}
+
+uint64_t QueryResultCache::GetHitCount() const {
+    uint64_t hit_count = 0;
+    for (const Shard& shard : shards_) {
+        std::lock_guard lock(shard.mutex);
+        hit_count += shard.hit_count;
+    }
+    return hit_count;
+}
+
+uint64_t QueryResultCache::GetMissCount() const {
+    uint64_t miss_count = 0;
+    for (const Shard& shard : shards_) {
+        std::lock_guard lock(shard.mutex);
+        miss_count += shard.miss_count;
+    }
+    return miss_count;
+}
+
+double QueryResultCache::GetHitRate() const {
+    const uint64_t hit_count = GetHitCount();
+    const uint64_t lookup_count = hit_count + GetMissCount();
+    return lookup_count == 0 ? 0.0 : static_cast<double>(hit_count) / lookup_count;
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
+
+bool QueryResultCache::FindEntry(const std::string& key, const SearchServer& search_server, std::vector<Document>& documents) {
+    Shard& shard = GetShard(key);
+    std::lock_guard lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        ++shard.miss_count;
+        return false;
+    }
+    const Entry& entry = it->second->second;
+    if (entry.instance_id != search_server.GetInstanceId() || entry.generation != search_server.GetGeneration()) {
+        shard.entries.erase(it->second);
+        shard.index.erase(it);
+        ++shard.miss_count;
+        return false;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    documents = entry.documents;
+    ++shard.hit_count;
+    return true;
+}
+
+void QueryResultCache::StoreEntry(std::string key, Entry entry) {
+    Shard& shard = GetShard(key);
+    std::lock_guard lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        it->second->second = std::move(entry);
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return;
+    }
+    shard.entries.emplace_front(std::move(key), std::move(entry));
+    shard.index.emplace(shard.entries.front().first, shard.entries.begin());
+    if (shard.entries.size() > shard_capacity_) {
+        shard.index.erase(shard.entries.back().first);
+        shard.entries.pop_back();
+    }
+}
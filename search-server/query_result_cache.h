@@ -0,0 +1,53 @@
+#pragma once
+#include "document.h"
+#include "search_server.h"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Sharded LRU cache of FindTopDocuments results by status. Keys are canonical queries, so equivalent
+// spellings of a query share an entry. An entry is only valid for the server instance and generation
+// it was computed for, so writes to the server invalidate the cache without touching it
+class QueryResultCache {
+public:
+    explicit QueryResultCache(size_t capacity, size_t shard_count = 16);
+
+    std::vector<Document> FindTopDocuments(const SearchServer& search_server, std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL);
+
+    uint64_t GetHitCount() const;
+    uint64_t GetMissCount() const;
+    // Share of lookups answered from the cache, zero before the first lookup
+    double GetHitRate() const;
+
+private:
+    struct Entry {
+        uint64_t instance_id;
+        uint64_t generation;
+        std::vector<Document> documents;
+    };
+
+    using EntryList = std::list<std::pair<std::string, Entry>>;
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        // Most recently used first
+        EntryList entries;
+        // Keys point into the list, whose nodes never move
+        std::unordered_map<std::string_view, EntryList::iterator> index;
+        uint64_t hit_count = 0;
+        uint64_t miss_count = 0;
+    };
+
+    Shard& GetShard(const std::string& key);
+    bool FindEntry(const std::string& key, const SearchServer& search_server, std::vector<Document>& documents);
+    void StoreEntry(std::string key, Entry entry);
+
+    size_t shard_capacity_;
+    std::vector<Shard> shards_;
+};
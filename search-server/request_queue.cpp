@@ -1,26 +1,125 @@
 #include "request_queue.h" 
-#include <numeric> 
+#include <algorithm>
+#include <thread>
 using namespace std;
 
+RequestQueue::RequestQueue(const SearchServer& search_server, QueryResultCache* cache, chrono::steady_clock::duration window)
+    : server_(search_server)
+    , cache_(cache)
+    , start_(chrono::steady_clock::now())
+    , slot_duration_(max<chrono::steady_clock::duration>(window / WINDOW_SLOT_COUNT, chrono::steady_clock::duration(1)))
+    , slots_(make_unique<array<WindowSlot, WINDOW_SLOT_COUNT>>()) {
+    for (WindowSlot& slot : *slots_) {
+        slot.period.store(-1, memory_order_relaxed);
+        slot.request_count.store(0, memory_order_relaxed);
+        slot.empty_count.store(0, memory_order_relaxed);
+        for (auto& count : slot.latency_counts) {
+            count.store(0, memory_order_relaxed);
+        }
+    }
+}
+
 //         Request_queue
 vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus document_status) {
-    return AddFindRequest(raw_query,
-        [document_status]([[maybe_unused]] int document_id, DocumentStatus status,
-            [[maybe_unused]] int rating) { return status == document_status; });
+    const auto start = chrono::steady_clock::now();
+    std::vector<Document> response = cache_ != nullptr
+        ? cache_->FindTopDocuments(server_, raw_query, document_status)
+        : server_.FindTopDocuments(raw_query, document_status);
+    RecordRequest(start, response);
+    return response;
 }
 
 //     ,     
 int RequestQueue::GetNoResultRequests() const {
-    return empty_responses_count_;
+    const int64_t current_period = GetPeriod(chrono::steady_clock::now());
+    uint64_t empty_count = 0;
+    for (const WindowSlot& slot : *slots_) {
+        const int64_t period = slot.period.load(memory_order_acquire);
+        if (period >= 0 && current_period - period < static_cast<int64_t>(WINDOW_SLOT_COUNT)) {
+            empty_count += slot.empty_count.load(memory_order_relaxed);
+        }
+    }
+    return static_cast<int>(empty_count);
 }
 
-//            
-void RequestQueue::UpdateRequestsInformation(const vector<Document>& response) {
-    if (requests_.size() == kMinutesInDay) {
-        if (requests_.front().IsEmpty())
-            --empty_responses_count_;
-        requests_.pop_front();
+RequestStatistics RequestQueue::GetStatistics() const {
+    const auto now = chrono::steady_clock::now();
+    const int64_t current_period = GetPeriod(now);
+    RequestStatistics statistics;
+    uint64_t empty_count = 0;
+    DurationHistogram::Counts latency_counts{};
+    for (const WindowSlot& slot : *slots_) {
+        const int64_t period = slot.period.load(memory_order_acquire);
+        if (period < 0 || current_period - period >= static_cast<int64_t>(WINDOW_SLOT_COUNT)) {
+            continue;
+        }
+        statistics.request_count += slot.request_count.load(memory_order_relaxed);
+        empty_count += slot.empty_count.load(memory_order_relaxed);
+        for (size_t bucket = 0; bucket < DurationHistogram::BUCKET_COUNT; ++bucket) {
+            latency_counts[bucket] += slot.latency_counts[bucket].load(memory_order_relaxed);
+        }
+    }
+    if (statistics.request_count == 0) {
+        return statistics;
     }
-    if (response.empty())
-        ++empty_responses_count_;
-}
\ No newline at end of file
+
+    // Until the queue has existed for a whole window, rates are taken over its lifetime
+    const auto covered = min(now - start_, slot_duration_ * static_cast<int64_t>(WINDOW_SLOT_COUNT));
+    const double covered_seconds = max(chrono::duration<double>(covered).count(), 1e-9);
+    statistics.queries_per_second = statistics.request_count / covered_seconds;
+    statistics.empty_result_rate = static_cast<double>(empty_count) / statistics.request_count;
+
+    const auto percentile = [&latency_counts, &statistics](double fraction) {
+        const chrono::nanoseconds latency(DurationHistogram::GetPercentile(latency_counts, statistics.request_count, fraction));
+        return chrono::duration_cast<chrono::microseconds>(latency);
+    };
+    statistics.latency_p50 = percentile(0.5);
+    statistics.latency_p99 = percentile(0.99);
+    statistics.latency_p999 = percentile(0.999);
+    return statistics;
+}
+
+void RequestQueue::RecordRequest(chrono::steady_clock::time_point start, const vector<Document>& response) {
+    const auto end = chrono::steady_clock::now();
+    WindowSlot* slot = AcquireSlot(GetPeriod(end));
+    if (slot == nullptr) {
+        return;
+    }
+    const auto latency = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+    slot->request_count.fetch_add(1, memory_order_relaxed);
+    if (response.empty()) {
+        slot->empty_count.fetch_add(1, memory_order_relaxed);
+    }
+    slot->latency_counts[DurationHistogram::GetBucket(static_cast<uint64_t>(max<int64_t>(latency, 0)))].fetch_add(1, memory_order_relaxed);
+}
+
+int64_t RequestQueue::GetPeriod(chrono::steady_clock::time_point time) const {
+    return (time - start_) / slot_duration_;
+}
+
+RequestQueue::WindowSlot* RequestQueue::AcquireSlot(int64_t period) {
+    WindowSlot& slot = (*slots_)[period % WINDOW_SLOT_COUNT];
+    int64_t slot_period = slot.period.load(memory_order_acquire);
+    while (slot_period != period) {
+        if (slot_period > period) {
+            // The thread was delayed for a whole window, its slot already serves a later period
+            return nullptr;
+        }
+        if (slot_period == RESETTING_PERIOD) {
+            this_thread::yield();
+            slot_period = slot.period.load(memory_order_acquire);
+            continue;
+        }
+        // The first request of a new period clears what the slot counted a window ago
+        if (slot.period.compare_exchange_weak(slot_period, RESETTING_PERIOD, memory_order_acquire)) {
+            slot.request_count.store(0, memory_order_relaxed);
+            slot.empty_count.store(0, memory_order_relaxed);
+            for (auto& count : slot.latency_counts) {
+                count.store(0, memory_order_relaxed);
+            }
+            slot.period.store(period, memory_order_release);
+            return &slot;
+        }
+    }
+    return &slot;
+}
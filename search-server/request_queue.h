@@ -1,12 +1,38 @@
 #pragma once 
-#include <deque> 
 #include "document.h" 
+#include "duration_histogram.h"
 #include "search_server.h" 
+#include "query_result_cache.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Request metrics over the sliding window of a RequestQueue
+struct RequestStatistics {
+    uint64_t request_count = 0;
+    double queries_per_second = 0.0;
+    double empty_result_rate = 0.0;
+    // Lower bounds of the DurationHistogram buckets holding the percentiles
+    std::chrono::microseconds latency_p50{ 0 };
+    std::chrono::microseconds latency_p99{ 0 };
+    std::chrono::microseconds latency_p999{ 0 };
+};
 
-
+// Keeps metrics of the requests made during the last window of wall-clock time. The window is a ring
+// of fixed slots, each covering window / WINDOW_SLOT_COUNT of time and reused once it falls out of the
+// window. Requests from many threads only update atomic counters of their slot
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server) : server_(search_server) {}
+    static constexpr size_t WINDOW_SLOT_COUNT = 60;
+
+    // Status requests are answered through the cache when one is given
+    explicit RequestQueue(const SearchServer& search_server, QueryResultCache* cache = nullptr,
+        std::chrono::steady_clock::duration window = std::chrono::minutes(kMinutesInDay));
+
     template <typename DocumentFilterFunction>
     std::vector<Document> AddFindRequest(const std::string& raw_query,
         DocumentFilterFunction document_filter_function);
@@ -14,39 +40,40 @@ public:
     std::vector<Document> AddFindRequest(const std::string& raw_query,
         DocumentStatus document_status = DocumentStatus::ACTUAL);
 
+    // Requests of the window that found no documents
     [[nodiscard]] int GetNoResultRequests() const;
+    [[nodiscard]] RequestStatistics GetStatistics() const;
+
 private:
     static const int kMinutesInDay{ 1440 };
-
-    struct QueryResult {
-        std::string query;
-        int found_documents_count{ 0 };
-
-
-        QueryResult(const std::string& query, int found_documents_count)
-            : query(query), found_documents_count(found_documents_count) {}
-
-
-        bool IsEmpty() const {
-            return found_documents_count == 0;
-        }
+    // Period of a slot while its counters are being cleared
+    static constexpr int64_t RESETTING_PERIOD = -2;
+
+    struct alignas(64) WindowSlot {
+        // Number of the slot-long period since construction the counters belong to
+        std::atomic<int64_t> period;
+        std::atomic<uint64_t> request_count;
+        std::atomic<uint64_t> empty_count;
+        // Nanoseconds in DurationHistogram buckets
+        std::array<std::atomic<uint64_t>, DurationHistogram::BUCKET_COUNT> latency_counts;
     };
 
+    void RecordRequest(std::chrono::steady_clock::time_point start, const std::vector<Document>& response);
+    int64_t GetPeriod(std::chrono::steady_clock::time_point time) const;
+    WindowSlot* AcquireSlot(int64_t period);
 
-    void UpdateRequestsInformation(const std::vector<Document>& response);
-
-
-    std::deque<QueryResult> requests_;
     const SearchServer& server_;
-    int empty_responses_count_{ 0 };
+    QueryResultCache* cache_;
+    const std::chrono::steady_clock::time_point start_;
+    const std::chrono::steady_clock::duration slot_duration_;
+    // A few hundred kilobytes with the histograms, kept off the stack of whoever owns the queue
+    std::unique_ptr<std::array<WindowSlot, WINDOW_SLOT_COUNT>> slots_;
 };
 
-
-
 template <typename DocumentFilterFunction>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentFilterFunction document_filter_function) {
+    const auto start = std::chrono::steady_clock::now();
     std::vector<Document> response = server_.FindTopDocuments(raw_query, document_filter_function);
-    UpdateRequestsInformation(response);
-    requests_.emplace_back(raw_query, response.size());
+    RecordRequest(start, response);
     return response;
 }
@@ -0,0 +1,122 @@
+#include "roaring_bitmap.h"
+#include <algorithm>
+
+bool RoaringBitmap::Container::IsBitset() const {
+    return !bits.empty();
+}
+
+bool RoaringBitmap::Container::Add(uint16_t low) {
+    if (IsBitset()) {
+        uint64_t& word = bits[low / 64];
+        const uint64_t mask = uint64_t{ 1 } << (low % 64);
+        if (word & mask) {
+            return false;
+        }
+        word |= mask;
+        ++cardinality;
+        return true;
+    }
+
+    const auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it != array.end() && *it == low) {
+        return false;
+    }
+    array.insert(it, low);
+    ++cardinality;
+    if (array.size() > MAX_ARRAY_SIZE) {
+        bits.assign(BITSET_WORDS, 0);
+        for (const uint16_t value : array) {
+            bits[value / 64] |= uint64_t{ 1 } << (value % 64);
+        }
+        array.clear();
+        array.shrink_to_fit();
+    }
+    return true;
+}
+
+bool RoaringBitmap::Container::Remove(uint16_t low) {
+    if (IsBitset()) {
+        uint64_t& word = bits[low / 64];
+        const uint64_t mask = uint64_t{ 1 } << (low % 64);
+        if (!(word & mask)) {
+            return false;
+        }
+        word &= ~mask;
+        --cardinality;
+        // Converting back at half the limit keeps a container near the limit from flipping on every write
+        if (cardinality <= MAX_ARRAY_SIZE / 2) {
+            array.reserve(cardinality);
+            for (size_t i = 0; i < BITSET_WORDS; ++i) {
+                for (uint64_t word_bits = bits[i]; word_bits != 0; word_bits &= word_bits - 1) {
+                    array.push_back(static_cast<uint16_t>(i * 64 + __builtin_ctzll(word_bits)));
+                }
+            }
+            bits.clear();
+            bits.shrink_to_fit();
+        }
+        return true;
+    }
+
+    const auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it == array.end() || *it != low) {
+        return false;
+    }
+    array.erase(it);
+    --cardinality;
+    return true;
+}
+
+bool RoaringBitmap::Container::Contains(uint16_t low) const {
+    if (IsBitset()) {
+        return (bits[low / 64] >> (low % 64)) & 1;
+    }
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+std::vector<RoaringBitmap::Container>::iterator RoaringBitmap::FindContainer(uint16_t key) {
+    return std::lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+        return container.key < key;
+        });
+}
+
+std::vector<RoaringBitmap::Container>::const_iterator RoaringBitmap::FindContainer(uint16_t key) const {
+    return std::lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+        return container.key < key;
+        });
+}
+
+void RoaringBitmap::Add(uint32_t value) {
+    const uint16_t key = static_cast<uint16_t>(value >> 16);
+    auto it = FindContainer(key);
+    if (it == containers_.end() || it->key != key) {
+        it = containers_.insert(it, Container{});
+        it->key = key;
+    }
+    if (it->Add(static_cast<uint16_t>(value))) {
+        ++size_;
+    }
+}
+
+void RoaringBitmap::Remove(uint32_t value) {
+    const uint16_t key = static_cast<uint16_t>(value >> 16);
+    const auto it = FindContainer(key);
+    if (it == containers_.end() || it->key != key) {
+        return;
+    }
+    if (it->Remove(static_cast<uint16_t>(value))) {
+        --size_;
+        if (it->cardinality == 0) {
+            containers_.erase(it);
+        }
+    }
+}
+
+bool RoaringBitmap::Contains(uint32_t value) const {
+    const uint16_t key = static_cast<uint16_t>(value >> 16);
+    const auto it = FindContainer(key);
+    return it != containers_.end() && it->key == key && it->Contains(static_cast<uint16_t>(value));
+}
+
+size_t RoaringBitmap::Size() const {
+    return size_;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compressed set of 32-bit values in the spirit of Roaring bitmaps. Values are grouped
+// by their high 16 bits; a group is a sorted array while sparse and a plain bitset once dense
+class RoaringBitmap {
+public:
+    void Add(uint32_t value);
+    void Remove(uint32_t value);
+    bool Contains(uint32_t value) const;
+    size_t Size() const;
+
+private:
+    static constexpr size_t MAX_ARRAY_SIZE = 4096;
+    static constexpr size_t BITSET_WORDS = (1 << 16) / 64;
+
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        // Exactly one of them is used: array while cardinality <= MAX_ARRAY_SIZE, bits otherwise
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bits;
+
+        bool IsBitset() const;
+        bool Add(uint16_t low);
+        bool Remove(uint16_t low);
+        bool Contains(uint16_t low) const;
+    };
+
+    std::vector<Container>::iterator FindContainer(uint16_t key);
+    std::vector<Container>::const_iterator FindContainer(uint16_t key) const;
+
+    // Sorted by key
+    std::vector<Container> containers_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,17 @@
+#include "score_accumulator.h"
+
+ScoreAccumulator& ScoreAccumulator::ForCurrentThread() {
+    thread_local ScoreAccumulator accumulator;
+    return accumulator;
+}
+
+void ScoreAccumulator::Reset(size_t size) {
+    for (const size_t slot : touched_) {
+        states_[slot] = SlotState::EMPTY;
+    }
+    touched_.clear();
+    if (states_.size() < size) {
+        states_.resize(size, SlotState::EMPTY);
+        scores_.resize(size);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Dense relevance accumulator for a contiguous range of document ordinals.
+// It is reused between queries: Reset clears only the slots touched since the previous call
+class ScoreAccumulator {
+public:
+    // Accumulator owned by the calling thread. It must not be shared by nested searches
+    static ScoreAccumulator& ForCurrentThread();
+
+    void Reset(size_t size);
+    void Add(size_t slot, double value);
+    // Excluded slots ignore further additions and are never reported
+    void Exclude(size_t slot);
+
+    // Calls callback(slot, relevance) for every matched slot that is not excluded
+    template <typename Callback>
+    void ForEachMatched(Callback callback) const;
+
+private:
+    enum class SlotState : uint8_t {
+        EMPTY,
+        MATCHED,
+        EXCLUDED,
+    };
+
+    std::vector<double> scores_;
+    std::vector<SlotState> states_;
+    std::vector<size_t> touched_;
+};
+
+inline void ScoreAccumulator::Add(size_t slot, double value) {
+    switch (states_[slot]) {
+    case SlotState::EMPTY:
+        states_[slot] = SlotState::MATCHED;
+        scores_[slot] = value;
+        touched_.push_back(slot);
+        break;
+    case SlotState::MATCHED:
+        scores_[slot] += value;
+        break;
+    case SlotState::EXCLUDED:
+        break;
+    }
+}
+
+inline void ScoreAccumulator::Exclude(size_t slot) {
+    if (states_[slot] == SlotState::EMPTY) {
+        touched_.push_back(slot);
+    }
+    states_[slot] = SlotState::EXCLUDED;
+}
+
+template <typename Callback>
+void ScoreAccumulator::ForEachMatched(Callback callback) const {
+    for (const size_t slot : touched_) {
+        if (states_[slot] == SlotState::MATCHED) {
+            callback(slot, scores_[slot]);
+        }
+    }
+}
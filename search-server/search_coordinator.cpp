@@ -0,0 +1,192 @@
+#include "search_coordinator.h"
+#include "search_protocol.h"
+#include <algorithm>
+#include <poll.h>
+#include <stdexcept>
+
+using namespace std::literals;
+
+SearchCoordinator::SearchCoordinator(std::vector<std::string> shard_endpoints, std::chrono::milliseconds timeout)
+    : shards_(shard_endpoints.size())
+    , timeout_(timeout) {
+    for (size_t shard = 0; shard < shards_.size(); ++shard) {
+        shards_[shard].endpoint = std::move(shard_endpoints[shard]);
+    }
+}
+
+DistributedSearchResult SearchCoordinator::FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t top_count) {
+    MessageWriter collect_request(MessageType::COLLECT_STATISTICS);
+    collect_request.WriteString(raw_query);
+    const auto statistics_replies = Exchange(collect_request.Finish(), MessageType::STATISTICS, std::vector<bool>(shards_.size(), true));
+
+    CorpusStatistics statistics;
+    std::vector<bool> targets(shards_.size(), false);
+    for (size_t shard = 0; shard < shards_.size(); ++shard) {
+        if (!statistics_replies[shard]) {
+            continue;
+        }
+        const CorpusStatistics shard_statistics = MessageReader(*statistics_replies[shard]).ReadStatistics();
+        statistics.document_count += shard_statistics.document_count;
+        for (const auto& [word, document_freq] : shard_statistics.document_freqs) {
+            statistics.document_freqs[word] += document_freq;
+        }
+        targets[shard] = true;
+    }
+
+    MessageWriter find_request(MessageType::FIND_TOP_DOCUMENTS);
+    find_request.WriteString(raw_query);
+    find_request.WriteValue(status);
+    find_request.WriteValue(static_cast<uint32_t>(top_count));
+    find_request.WriteStatistics(statistics);
+    const auto document_replies = Exchange(find_request.Finish(), MessageType::DOCUMENTS, targets);
+
+    DistributedSearchResult result;
+    for (size_t shard = 0; shard < shards_.size(); ++shard) {
+        if (!document_replies[shard]) {
+            result.failed_shards.push_back(shard);
+            continue;
+        }
+        const std::vector<Document> documents = MessageReader(*document_replies[shard]).ReadDocuments();
+        result.documents.insert(result.documents.end(), documents.begin(), documents.end());
+    }
+    const auto top_end = result.documents.begin() + std::min(top_count, result.documents.size());
+    std::partial_sort(result.documents.begin(), top_end, result.documents.end(), IsMoreRelevant);
+    result.documents.erase(top_end, result.documents.end());
+    return result;
+}
+
+std::tuple<std::vector<std::string>, DocumentStatus> SearchCoordinator::MatchDocument(std::string_view raw_query, int document_id) {
+    MessageWriter request(MessageType::MATCH_DOCUMENT);
+    request.WriteString(raw_query);
+    request.WriteValue(static_cast<int32_t>(document_id));
+    const auto replies = Exchange(request.Finish(), MessageType::MATCHED_WORDS, std::vector<bool>(shards_.size(), true));
+
+    bool all_answered = true;
+    for (const auto& reply : replies) {
+        if (!reply) {
+            all_answered = false;
+            continue;
+        }
+        MessageReader reader(*reply);
+        if (reader.GetType() != MessageType::MATCHED_WORDS) {
+            continue;
+        }
+        const auto status = reader.ReadValue<DocumentStatus>();
+        std::vector<std::string> words(reader.ReadValue<uint32_t>());
+        for (std::string& word : words) {
+            word = reader.ReadString();
+        }
+        return { words, status };
+    }
+    if (!all_answered) {
+        throw std::runtime_error("Document "s + std::to_string(document_id) + " not found on the shards that answered"s);
+    }
+    throw std::out_of_range("Document "s + std::to_string(document_id) + " not found"s);
+}
+
+size_t SearchCoordinator::GetShardCount() const {
+    return shards_.size();
+}
+
+std::vector<std::optional<std::string>> SearchCoordinator::Exchange(const std::string& request, MessageType reply_type,
+    const std::vector<bool>& targets) {
+    const Clock::time_point deadline = Clock::now() + timeout_;
+    std::vector<std::optional<std::string>> replies(shards_.size());
+    std::vector<ShardConnection> connections(shards_.size());
+    std::vector<size_t> waiting;
+    for (size_t shard = 0; shard < shards_.size(); ++shard) {
+        if (!targets[shard]) {
+            continue;
+        }
+        try {
+            connections[shard] = TakeConnection(shards_[shard]);
+            connections[shard].connection.SendAll(request);
+            waiting.push_back(shard);
+        }
+        catch (const std::runtime_error&) {
+            connections[shard].connection.Close();
+        }
+    }
+
+    std::vector<pollfd> descriptors;
+    std::string message;
+    std::optional<std::string> invalid_argument;
+    while (!waiting.empty()) {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+        if (remaining.count() <= 0) {
+            break;
+        }
+        descriptors.clear();
+        for (const size_t shard : waiting) {
+            descriptors.push_back({ connections[shard].connection.GetDescriptor(), POLLIN, 0 });
+        }
+        if (poll(descriptors.data(), descriptors.size(), static_cast<int>(remaining.count())) <= 0) {
+            continue;
+        }
+
+        std::vector<size_t> still_waiting;
+        for (size_t i = 0; i < waiting.size(); ++i) {
+            const size_t shard = waiting[i];
+            ShardConnection& connection = connections[shard];
+            if (descriptors[i].revents == 0) {
+                still_waiting.push_back(shard);
+                continue;
+            }
+            try {
+                if (!connection.connection.Receive(connection.buffer, false)) {
+                    throw std::runtime_error("Shard closed the connection"s);
+                }
+                if (!ExtractMessage(connection.buffer, message)) {
+                    still_waiting.push_back(shard);
+                    continue;
+                }
+                MessageReader reader(message);
+                if (reader.GetType() == MessageType::ERROR) {
+                    const auto kind = reader.ReadValue<ErrorKind>();
+                    const std::string_view text = reader.ReadString();
+                    if (kind == ErrorKind::INVALID_ARGUMENT) {
+                        invalid_argument = text;
+                        ReturnConnection(shards_[shard], std::move(connection));
+                        continue;
+                    }
+                    if (kind != ErrorKind::OUT_OF_RANGE) {
+                        throw std::runtime_error(std::string(text));
+                    }
+                }
+                else if (reader.GetType() != reply_type) {
+                    throw std::runtime_error("Unexpected reply type"s);
+                }
+                replies[shard] = std::move(message);
+                ReturnConnection(shards_[shard], std::move(connection));
+            }
+            catch (const std::runtime_error&) {
+                connection.connection.Close();
+            }
+        }
+        waiting = std::move(still_waiting);
+    }
+
+    // Connections of shards still waiting are closed here, a late reply would be taken for the
+    // answer to the next request
+    if (invalid_argument) {
+        throw std::invalid_argument(*invalid_argument);
+    }
+    return replies;
+}
+
+SearchCoordinator::ShardConnection SearchCoordinator::TakeConnection(Shard& shard) {
+    {
+        std::lock_guard lock(shard.mutex);
+        if (!shard.idle_connections.empty()) {
+            ShardConnection connection = std::move(shard.idle_connections.back());
+            shard.idle_connections.pop_back();
+            return connection;
+        }
+    }
+    return { Connection::Connect(shard.endpoint), std::string() };
+}
+
+void SearchCoordinator::ReturnConnection(Shard& shard, ShardConnection connection) {
+    std::lock_guard lock(shard.mutex);
+    shard.idle_connections.push_back(std::move(connection));
+}
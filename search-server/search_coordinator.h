@@ -0,0 +1,68 @@
+#pragma once
+#include "document.h"
+#include "search_protocol.h"
+#include "search_server.h"
+#include "socket_connection.h"
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Documents of a distributed search. Shards that failed or did not answer in time are listed,
+// their documents are missing and their counts are left out of the IDF
+struct DistributedSearchResult {
+    std::vector<Document> documents;
+    std::vector<size_t> failed_shards;
+};
+
+// Searches a corpus split across ShardService processes. A query takes two rounds: the document
+// frequencies of its words are gathered from all shards, then every shard scores with their sums
+// and returns its best documents, which are merged. So results are those of one SearchServer
+// with all documents. A shard that misses the deadline of a round is disconnected and retried
+// on the next query. Calls from several threads run at the same time, each on its own connections
+class SearchCoordinator {
+public:
+    SearchCoordinator(std::vector<std::string> shard_endpoints, std::chrono::milliseconds timeout);
+
+    // Throws std::invalid_argument for an invalid query
+    DistributedSearchResult FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT);
+    // Asks every shard. Throws std::out_of_range if all of them answered and none has the document,
+    // std::runtime_error if the document may be on a shard that did not answer
+    std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id);
+
+    size_t GetShardCount() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct ShardConnection {
+        Connection connection;
+        // Received bytes of the reply being read
+        std::string buffer;
+    };
+
+    struct Shard {
+        std::string endpoint;
+        // Guards idle_connections. A connection is used by one call at a time, so concurrent
+        // calls take different connections and only wait for each other to take or return one
+        std::mutex mutex;
+        std::vector<ShardConnection> idle_connections;
+    };
+
+    // Sends the request to the shards marked in targets and waits for their replies until the
+    // deadline. A reply is a message of reply_type or an out of range error. Shards that fail,
+    // answer otherwise or miss the deadline get no reply; an invalid argument error of any
+    // shard is thrown as std::invalid_argument once the others have answered
+    std::vector<std::optional<std::string>> Exchange(const std::string& request, MessageType reply_type,
+        const std::vector<bool>& targets);
+    // Returns an idle connection to the shard or opens a new one
+    ShardConnection TakeConnection(Shard& shard);
+    void ReturnConnection(Shard& shard, ShardConnection connection);
+
+    std::vector<Shard> shards_;
+    const std::chrono::milliseconds timeout_;
+};
@@ -0,0 +1,105 @@
+#include "search_protocol.h"
+
+using namespace std::literals;
+
+MessageWriter::MessageWriter(MessageType type) {
+    // The size is filled in by Finish
+    frame_.resize(sizeof(uint32_t));
+    WriteValue(type);
+}
+
+void MessageWriter::WriteString(std::string_view text) {
+    WriteValue(static_cast<uint32_t>(text.size()));
+    frame_.append(text);
+}
+
+void MessageWriter::WriteStatistics(const CorpusStatistics& statistics) {
+    WriteValue(static_cast<int32_t>(statistics.document_count));
+    WriteValue(static_cast<uint32_t>(statistics.document_freqs.size()));
+    for (const auto& [word, document_freq] : statistics.document_freqs) {
+        WriteString(word);
+        WriteValue(static_cast<int32_t>(document_freq));
+    }
+}
+
+void MessageWriter::WriteDocuments(const std::vector<Document>& documents) {
+    WriteValue(static_cast<uint32_t>(documents.size()));
+    for (const Document& document : documents) {
+        WriteValue(static_cast<int32_t>(document.id));
+        WriteValue(document.relevance);
+        WriteValue(static_cast<int32_t>(document.rating));
+    }
+}
+
+const std::string& MessageWriter::Finish() {
+    const uint32_t size = static_cast<uint32_t>(frame_.size() - sizeof(uint32_t));
+    std::memcpy(frame_.data(), &size, sizeof(size));
+    return frame_;
+}
+
+MessageReader::MessageReader(std::string_view message)
+    : message_(message) {
+    if (message_.empty()) {
+        throw std::runtime_error("Message is empty"s);
+    }
+    type_ = static_cast<MessageType>(message_[0]);
+}
+
+MessageType MessageReader::GetType() const {
+    return type_;
+}
+
+std::string_view MessageReader::ReadString() {
+    const uint32_t size = ReadValue<uint32_t>();
+    return { ReadBytes(size), size };
+}
+
+CorpusStatistics MessageReader::ReadStatistics() {
+    CorpusStatistics statistics;
+    statistics.document_count = ReadValue<int32_t>();
+    const uint32_t word_count = ReadValue<uint32_t>();
+    for (uint32_t i = 0; i < word_count; ++i) {
+        const std::string_view word = ReadString();
+        statistics.document_freqs.emplace(word, ReadValue<int32_t>());
+    }
+    return statistics;
+}
+
+std::vector<Document> MessageReader::ReadDocuments() {
+    const uint32_t count = ReadValue<uint32_t>();
+    std::vector<Document> documents;
+    for (uint32_t i = 0; i < count; ++i) {
+        Document document;
+        document.id = ReadValue<int32_t>();
+        document.relevance = ReadValue<double>();
+        document.rating = ReadValue<int32_t>();
+        documents.push_back(document);
+    }
+    return documents;
+}
+
+const char* MessageReader::ReadBytes(size_t size) {
+    if (size > message_.size() - offset_) {
+        throw std::runtime_error("Message is truncated"s);
+    }
+    const char* data = message_.data() + offset_;
+    offset_ += size;
+    return data;
+}
+
+bool ExtractMessage(std::string& buffer, std::string& message) {
+    uint32_t size = 0;
+    if (buffer.size() < sizeof(size)) {
+        return false;
+    }
+    std::memcpy(&size, buffer.data(), sizeof(size));
+    if (size > MAX_MESSAGE_SIZE) {
+        throw std::runtime_error("Message of "s + std::to_string(size) + " bytes is too large"s);
+    }
+    if (buffer.size() - sizeof(size) < size) {
+        return false;
+    }
+    message.assign(buffer, sizeof(size), size);
+    buffer.erase(0, sizeof(size) + size);
+    return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "document.h"
+#include "search_server.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Binary protocol between SearchCoordinator and ShardService. Every message is framed by its
+// size as uint32 and starts with its type. Numbers use the byte order of the machine, like
+// snapshots, because the processes run on one host. A connection carries one request at a time
+enum class MessageType : uint8_t {
+    // Query text -> STATISTICS with the live document count and the frequencies of the query words
+    COLLECT_STATISTICS = 1,
+    // Query text, DocumentStatus, top count and the statistics to score with -> DOCUMENTS
+    FIND_TOP_DOCUMENTS,
+    // Query text and document id -> MATCHED_WORDS
+    MATCH_DOCUMENT,
+    STATISTICS,
+    DOCUMENTS,
+    MATCHED_WORDS,
+    // ErrorKind and the exception text of a failed request
+    ERROR,
+};
+
+enum class ErrorKind : uint8_t {
+    INVALID_ARGUMENT,
+    OUT_OF_RANGE,
+    INTERNAL,
+};
+
+// Larger frames are treated as a broken stream
+const uint32_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
+class MessageWriter {
+public:
+    explicit MessageWriter(MessageType type);
+
+    template <typename T>
+    void WriteValue(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "Message values must be trivially copyable");
+        frame_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void WriteString(std::string_view text);
+    void WriteStatistics(const CorpusStatistics& statistics);
+    void WriteDocuments(const std::vector<Document>& documents);
+    // Returns the whole frame, size included
+    const std::string& Finish();
+
+private:
+    std::string frame_;
+};
+
+// Reads a message without its size. Reading past the end throws std::runtime_error
+class MessageReader {
+public:
+    explicit MessageReader(std::string_view message);
+
+    MessageType GetType() const;
+
+    template <typename T>
+    T ReadValue() {
+        static_assert(std::is_trivially_copyable_v<T>, "Message values must be trivially copyable");
+        T value;
+        std::memcpy(&value, ReadBytes(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string_view ReadString();
+    CorpusStatistics ReadStatistics();
+    std::vector<Document> ReadDocuments();
+
+private:
+    const char* ReadBytes(size_t size);
+
+    std::string_view message_;
+    MessageType type_;
+    size_t offset_ = 1;
+};
+
+// Moves the first complete message of buffer, without its size, into message. Returns false if
+// the buffer does not hold a whole frame yet, throws std::runtime_error on an oversized frame
+bool ExtractMessage(std::string& buffer, std::string& message);
@@ -1,5 +1,58 @@
 #include "search_server.h"
+#include "snapshot_file.h"
+#include <atomic>
 #include <cmath>
+#include <cstring>
+
+using namespace std::literals;
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+const uint32_t SNAPSHOT_VERSION = 2;
+// Reads back differently on a machine with another byte order
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t stop_word_count;
+    uint64_t term_count;
+    uint64_t posting_count;
+    uint64_t document_count;
+    uint64_t document_term_count;
+    double log_document_count;
+    int32_t removed_document_count;
+    uint8_t inverse_document_freqs_frozen;
+    uint8_t query_evaluation;
+};
+
+struct SnapshotDocument {
+    int32_t id;
+    int32_t rating;
+    int32_t status;
+    int32_t removed;
+    double inv_word_count;
+};
+
+// Offsets must start at zero, never decrease and end at the size of the array they split
+void CheckSnapshotOffsets(const uint64_t* offsets, size_t count, uint64_t total) {
+    if (offsets[0] != 0 || offsets[count] != total || !std::is_sorted(offsets, offsets + count + 1)) {
+        throw std::runtime_error("Snapshot is corrupted"s);
+    }
+}
+
+}
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
+        return lhs.rating > rhs.rating;
+    }
+    else {
+        return lhs.relevance > rhs.relevance;
+    }
+}
 
 SearchServer::SearchServer(const std::string& stop_words_text)
     : SearchServer(SplitIntoWords(stop_words_text)) { // Invoke delegating constructor from string container
@@ -14,8 +67,8 @@ void SearchServer::RemoveDocument(int document_id) {
     RemoveDocument(std::execution::seq, document_id);
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(std::execution::seq, raw_query, status);
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t top_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status, top_count);
 }
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query) const {
     return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
@@ -25,34 +78,540 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     return MatchDocument(std::execution::seq, raw_query, document_id);
 }
 
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(std::string_view raw_query,
+    const std::vector<int>& document_ids) const {
+    return MatchDocuments(std::execution::seq, raw_query, document_ids);
+}
+
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
     const std::vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    if ((document_id < 0) || (document_id_to_ordinal_.count(document_id) > 0)) {
         throw std::invalid_argument("Invalid document_id"s);
     }
 
-    const auto words = SplitIntoWordsNoStop(document);
+    std::vector<std::string_view> words;
+    SplitIntoWordsNoStop(document, words);
     size_t document_size = words.size();
     const double inv_word_count = 1.0 / document_size;
-    for (std::string_view word_view : words) {
-        std::string word{ word_view.data(), word_view.size() };
-        word_to_document_freqs_[std::string(word)][document_id] += inv_word_count;
-        document_to_word_[document_id][word_to_document_freqs_.find(word)->first] += 1.0 / document_size;
+    std::vector<size_t> term_ids;
+    term_ids.reserve(words.size());
+    for (std::string_view word : words) {
+        const size_t term_id = terms_.Intern(word);
+        if (term_id == term_postings_.size()) {
+            term_postings_.emplace_back();
+            term_document_freqs_.push_back(0);
+            // log(1): the document being added is the first one with this term
+            term_log_document_freqs_.push_back(0.0);
+        }
+        term_ids.push_back(term_id);
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+
+    const int ordinal = static_cast<int>(documents_.size());
+    std::vector<TermFrequency> document_terms;
+    for (auto it = term_ids.begin(); it != term_ids.end();) {
+        const auto run_end = std::upper_bound(it, term_ids.end(), *it);
+        const uint32_t term_count = static_cast<uint32_t>(run_end - it);
+        term_postings_[*it].Add(ordinal, term_count, term_count * inv_word_count);
+        ++term_document_freqs_[*it];
+        UpdateInverseDocumentFreq(*it);
+        document_terms.push_back({ *it, term_count });
+        it = run_end;
     }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
-    document_ids_.push_back(document_id);
+    documents_.push_back({ document_id, ComputeAverageRating(ratings), status, false, std::move(document_terms) });
+    inv_word_counts_.push_back(inv_word_count);
+    document_id_to_ordinal_.emplace(document_id, ordinal);
+    status_ordinals_[status].Add(ordinal);
+    UpdateLogDocumentCount();
+    ++generation_;
+}
+
+void SearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    AddDocuments(std::execution::seq, documents);
+}
+
+void SearchServer::CheckNewDocument(int document_id, std::string_view document) const {
+    if ((document_id < 0) || (document_id_to_ordinal_.count(document_id) > 0)) {
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    thread_local std::vector<WordToken> tokens;
+    SplitIntoWords(document, tokens);
+    for (const WordToken& token : tokens) {
+        if (token.has_control_chars) {
+            throw std::invalid_argument("Word "s + std::string(token.word) + " is invalid"s);
+        }
+    }
+}
+
+void SearchServer::IndexIngestChunk(const std::vector<NewDocument>& documents, int first_ordinal, IngestChunk& chunk) const {
+    const size_t chunk_size = chunk.last_document - chunk.first_document;
+    chunk.document_terms.resize(chunk_size);
+    chunk.errors.resize(chunk_size);
+    chunk.inv_word_counts.resize(chunk_size);
+    std::vector<size_t> term_ids;
+    std::vector<std::string_view> words;
+    for (size_t i = chunk.first_document; i < chunk.last_document; ++i) {
+        try {
+            SplitIntoWordsNoStop(documents[i].text, words);
+        }
+        catch (...) {
+            chunk.errors[i - chunk.first_document] = std::current_exception();
+            continue;
+        }
+
+        term_ids.clear();
+        for (std::string_view word : words) {
+            const auto [it, inserted] = chunk.term_ids.emplace(word, chunk.terms.size());
+            if (inserted) {
+                chunk.terms.push_back(word);
+                chunk.postings.emplace_back();
+            }
+            term_ids.push_back(it->second);
+        }
+        std::sort(term_ids.begin(), term_ids.end());
+
+        const int ordinal = first_ordinal + static_cast<int>(i);
+        chunk.inv_word_counts[i - chunk.first_document] = 1.0 / words.size();
+        std::vector<TermFrequency>& document_terms = chunk.document_terms[i - chunk.first_document];
+        for (auto it = term_ids.begin(); it != term_ids.end();) {
+            const auto run_end = std::upper_bound(it, term_ids.end(), *it);
+            const uint32_t term_count = static_cast<uint32_t>(run_end - it);
+            chunk.postings[*it].emplace_back(ordinal, term_count);
+            document_terms.push_back({ *it, term_count });
+            it = run_end;
+        }
+    }
+}
+
+void SearchServer::CheckNewDocuments(const std::vector<NewDocument>& documents, const std::vector<IngestChunk>& chunks) const {
+    std::unordered_set<int> batch_ids;
+    for (const IngestChunk& chunk : chunks) {
+        for (size_t i = chunk.first_document; i < chunk.last_document; ++i) {
+            const int document_id = documents[i].id;
+            if (document_id < 0 || document_id_to_ordinal_.count(document_id) > 0 || !batch_ids.insert(document_id).second) {
+                throw std::invalid_argument("Invalid document_id"s);
+            }
+            if (chunk.errors[i - chunk.first_document]) {
+                std::rethrow_exception(chunk.errors[i - chunk.first_document]);
+            }
+        }
+    }
+}
+
+std::vector<std::pair<size_t, std::vector<std::pair<size_t, size_t>>>> SearchServer::InternIngestTerms(std::vector<IngestChunk>& chunks) {
+    std::vector<std::pair<size_t, std::vector<std::pair<size_t, size_t>>>> term_sources;
+    std::unordered_map<size_t, size_t> term_source_indexes;
+    for (size_t chunk = 0; chunk < chunks.size(); ++chunk) {
+        IngestChunk& ingest_chunk = chunks[chunk];
+        ingest_chunk.global_term_ids.reserve(ingest_chunk.terms.size());
+        for (size_t local_term_id = 0; local_term_id < ingest_chunk.terms.size(); ++local_term_id) {
+            const size_t term_id = terms_.Intern(ingest_chunk.terms[local_term_id]);
+            if (term_id == term_postings_.size()) {
+                term_postings_.emplace_back();
+                term_document_freqs_.push_back(0);
+                term_log_document_freqs_.push_back(0.0);
+            }
+            ingest_chunk.global_term_ids.push_back(term_id);
+
+            const auto [it, inserted] = term_source_indexes.emplace(term_id, term_sources.size());
+            if (inserted) {
+                term_sources.emplace_back(term_id, std::vector<std::pair<size_t, size_t>>{});
+            }
+            term_sources[it->second].second.emplace_back(chunk, local_term_id);
+        }
+    }
+    return term_sources;
+}
+
+void SearchServer::Compact() {
+    if (removed_document_count_ == 0) {
+        return;
+    }
+
+    // Live documents and terms keep their relative order, so postings and
+    // per-document term lists stay sorted after renumbering
+    std::vector<int> new_ordinals(documents_.size(), -1);
+    std::vector<DocumentData> documents;
+    std::vector<double> inv_word_counts;
+    documents.reserve(documents_.size() - removed_document_count_);
+    inv_word_counts.reserve(documents.capacity());
+    for (size_t ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        if (!documents_[ordinal].removed) {
+            new_ordinals[ordinal] = static_cast<int>(documents.size());
+            documents.push_back(std::move(documents_[ordinal]));
+            inv_word_counts.push_back(inv_word_counts_[ordinal]);
+        }
+    }
+
+    TermDictionary terms;
+    std::vector<size_t> new_term_ids(term_postings_.size(), TermDictionary::npos);
+    std::vector<PostingList> term_postings;
+    std::vector<int> term_document_freqs;
+    std::vector<double> term_log_document_freqs;
+    for (size_t term_id = 0; term_id < term_postings_.size(); ++term_id) {
+        if (term_document_freqs_[term_id] == 0) {
+            continue;
+        }
+        new_term_ids[term_id] = terms.Intern(terms_.GetTerm(term_id));
+        PostingList& postings = term_postings.emplace_back();
+        term_postings_[term_id].ForEach([&](int ordinal, uint32_t term_count) {
+            if (new_ordinals[ordinal] >= 0) {
+                postings.Add(new_ordinals[ordinal], term_count, term_count * inv_word_counts_[ordinal]);
+            }
+            });
+        term_document_freqs.push_back(term_document_freqs_[term_id]);
+        term_log_document_freqs.push_back(term_log_document_freqs_[term_id]);
+    }
+
+    document_id_to_ordinal_.clear();
+    status_ordinals_.clear();
+    for (size_t ordinal = 0; ordinal < documents.size(); ++ordinal) {
+        DocumentData& document_data = documents[ordinal];
+        for (TermFrequency& term : document_data.terms) {
+            term.term_id = new_term_ids[term.term_id];
+        }
+        document_id_to_ordinal_.emplace(document_data.id, static_cast<int>(ordinal));
+        status_ordinals_[document_data.status].Add(static_cast<uint32_t>(ordinal));
+    }
+
+    documents_ = std::move(documents);
+    inv_word_counts_ = std::move(inv_word_counts);
+    terms_ = std::move(terms);
+    term_postings_ = std::move(term_postings);
+    term_document_freqs_ = std::move(term_document_freqs);
+    term_log_document_freqs_ = std::move(term_log_document_freqs);
+    removed_document_count_ = 0;
+    // Results keep their documents, but string_views into the old dictionary are invalidated
+    ++generation_;
+}
+
+void SearchServer::MergeFrom(const SearchServer& other, const std::unordered_set<int>& skipped_ids) {
+    if (stop_words_ != other.stop_words_) {
+        throw std::invalid_argument("Merged servers have different stop words"s);
+    }
+    const auto is_merged = [&skipped_ids](const DocumentData& document_data) {
+        return !document_data.removed && skipped_ids.count(document_data.id) == 0;
+    };
+    // Ids are checked before anything is merged, so a collision leaves this server unchanged
+    for (const DocumentData& other_data : other.documents_) {
+        if (is_merged(other_data) && document_id_to_ordinal_.count(other_data.id) > 0) {
+            throw std::invalid_argument("Invalid document_id"s);
+        }
+    }
+
+    std::vector<size_t> new_term_ids(other.term_postings_.size(), TermDictionary::npos);
+    for (size_t other_ordinal = 0; other_ordinal < other.documents_.size(); ++other_ordinal) {
+        const DocumentData& other_data = other.documents_[other_ordinal];
+        const double inv_word_count = other.inv_word_counts_[other_ordinal];
+        if (!is_merged(other_data)) {
+            continue;
+        }
+
+        const int ordinal = static_cast<int>(documents_.size());
+        DocumentData document_data = { other_data.id, other_data.rating, other_data.status, false, {} };
+        document_data.terms.reserve(other_data.terms.size());
+        for (const auto [other_term_id, term_count] : other_data.terms) {
+            size_t& term_id = new_term_ids[other_term_id];
+            if (term_id == TermDictionary::npos) {
+                term_id = terms_.Intern(other.terms_.GetTerm(other_term_id));
+                if (term_id == term_postings_.size()) {
+                    term_postings_.emplace_back();
+                    term_document_freqs_.push_back(0);
+                    term_log_document_freqs_.push_back(0.0);
+                }
+            }
+            term_postings_[term_id].Add(ordinal, term_count, term_count * inv_word_count);
+            ++term_document_freqs_[term_id];
+            document_data.terms.push_back({ term_id, term_count });
+        }
+        // Term ids of this server may come in another order than in other
+        std::sort(document_data.terms.begin(), document_data.terms.end(), [](const TermFrequency& lhs, const TermFrequency& rhs) {
+            return lhs.term_id < rhs.term_id;
+            });
+        document_id_to_ordinal_.emplace(document_data.id, ordinal);
+        status_ordinals_[document_data.status].Add(static_cast<uint32_t>(ordinal));
+        documents_.push_back(std::move(document_data));
+        inv_word_counts_.push_back(inv_word_count);
+    }
+    if (!inverse_document_freqs_frozen_) {
+        RefreshInverseDocumentFreqs();
+    }
+    ++generation_;
+}
+
+int SearchServer::GetRemovedDocumentCount() const {
+    return removed_document_count_;
 }
 
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return static_cast<int>(document_id_to_ordinal_.size());
+}
+
+void SearchServer::CollectStatistics(std::string_view raw_query, CorpusStatistics& statistics) const {
+    const QueryArena::Scope scope(QueryArena::ForCurrentThread());
+    const QueryView query = ParseQuery(raw_query, scope.GetResource());
+    statistics.document_count += GetDocumentCount();
+    for (std::string_view word : query.plus_words) {
+        const size_t term_id = FindIndexedTerm(word);
+        const int document_freq = term_id == TermDictionary::npos ? 0 : term_document_freqs_[term_id];
+        const auto it = statistics.document_freqs.find(word);
+        if (it == statistics.document_freqs.end()) {
+            statistics.document_freqs.emplace(word, document_freq);
+        }
+        else {
+            it->second += document_freq;
+        }
+    }
+}
+
+bool SearchServer::HasDocument(int document_id) const {
+    return document_id_to_ordinal_.count(document_id) > 0;
+}
+
+uint64_t SearchServer::GetGeneration() const {
+    return generation_;
+}
+
+uint64_t SearchServer::GetInstanceId() const {
+    return instance_id_.Get();
+}
+
+SearchServer::InstanceId::InstanceId()
+    : value_(MakeValue()) {
+}
+
+SearchServer::InstanceId::InstanceId(const InstanceId&)
+    : value_(MakeValue()) {
+}
+
+SearchServer::InstanceId& SearchServer::InstanceId::operator=(const InstanceId&) {
+    value_ = MakeValue();
+    return *this;
 }
 
-std::vector<int>::iterator SearchServer::begin() {
-    return document_ids_.begin();
+uint64_t SearchServer::InstanceId::Get() const {
+    return value_;
 }
 
-std::vector<int>::iterator SearchServer::end() {
-    return document_ids_.end();
+uint64_t SearchServer::InstanceId::MakeValue() {
+    static std::atomic<uint64_t> next_value = 1;
+    return next_value.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string SearchServer::GetCanonicalQuery(std::string_view raw_query) const {
+    const QueryArena::Scope scope(QueryArena::ForCurrentThread());
+    const QueryView query = ParseQuery(raw_query, scope.GetResource());
+    std::string canonical_query;
+    for (std::string_view word : query.plus_words) {
+        if (!canonical_query.empty()) {
+            canonical_query += ' ';
+        }
+        canonical_query += word;
+    }
+    for (std::string_view word : query.minus_words) {
+        if (!canonical_query.empty()) {
+            canonical_query += ' ';
+        }
+        canonical_query += '-';
+        canonical_query += word;
+    }
+    return canonical_query;
+}
+
+void SearchServer::SetQueryEvaluation(QueryEvaluation query_evaluation) {
+    query_evaluation_ = query_evaluation;
+}
+
+QueryEvaluation SearchServer::GetQueryEvaluation() const {
+    return query_evaluation_;
+}
+
+void SearchServer::FreezeInverseDocumentFreqs() {
+    inverse_document_freqs_frozen_ = true;
+}
+
+void SearchServer::RefreshInverseDocumentFreqs() {
+    for (size_t term_id = 0; term_id < term_postings_.size(); ++term_id) {
+        const int document_freq = term_document_freqs_[term_id];
+        term_log_document_freqs_[term_id] = document_freq > 0 ? log(document_freq) : 0.0;
+    }
+    const int document_count = GetDocumentCount();
+    log_document_count_ = document_count > 0 ? log(document_count) : 0.0;
+    ++generation_;
+}
+
+void SearchServer::UnfreezeInverseDocumentFreqs() {
+    inverse_document_freqs_frozen_ = false;
+    RefreshInverseDocumentFreqs();
+}
+
+void SearchServer::SaveSnapshot(const std::string& path) const {
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.stop_word_count = stop_words_.size();
+    header.term_count = term_postings_.size();
+    header.document_count = documents_.size();
+    for (const PostingList& postings : term_postings_) {
+        header.posting_count += postings.Size();
+    }
+    for (const DocumentData& document_data : documents_) {
+        header.document_term_count += document_data.terms.size();
+    }
+    header.log_document_count = log_document_count_;
+    header.removed_document_count = removed_document_count_;
+    header.inverse_document_freqs_frozen = inverse_document_freqs_frozen_;
+    header.query_evaluation = static_cast<uint8_t>(query_evaluation_);
+
+    SnapshotWriter writer(path);
+    writer.WriteValue(header);
+    writer.WriteStrings({ stop_words_.begin(), stop_words_.end() });
+    std::vector<std::string_view> terms;
+    terms.reserve(term_postings_.size());
+    for (size_t term_id = 0; term_id < term_postings_.size(); ++term_id) {
+        terms.push_back(terms_.GetTerm(term_id));
+    }
+    writer.WriteStrings(terms);
+
+    // Postings of all terms are concatenated, term_id owns [offsets[term_id], offsets[term_id + 1])
+    std::vector<uint64_t> posting_offsets = { 0 };
+    std::vector<int32_t> posting_ordinals;
+    std::vector<uint32_t> posting_term_counts;
+    posting_ordinals.reserve(header.posting_count);
+    posting_term_counts.reserve(header.posting_count);
+    for (const PostingList& postings : term_postings_) {
+        postings.ForEach([&](int ordinal, uint32_t term_count) {
+            posting_ordinals.push_back(ordinal);
+            posting_term_counts.push_back(term_count);
+            });
+        posting_offsets.push_back(posting_ordinals.size());
+    }
+    writer.WriteArray(posting_offsets.data(), posting_offsets.size());
+    writer.WriteArray(term_document_freqs_.data(), term_document_freqs_.size());
+    writer.WriteArray(term_log_document_freqs_.data(), term_log_document_freqs_.size());
+    writer.WriteArray(posting_ordinals.data(), posting_ordinals.size());
+    writer.WriteArray(posting_term_counts.data(), posting_term_counts.size());
+
+    std::vector<SnapshotDocument> documents;
+    std::vector<uint64_t> document_term_offsets = { 0 };
+    std::vector<uint32_t> document_term_ids;
+    std::vector<uint32_t> document_term_counts;
+    documents.reserve(documents_.size());
+    document_term_ids.reserve(header.document_term_count);
+    document_term_counts.reserve(header.document_term_count);
+    for (size_t ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        const DocumentData& document_data = documents_[ordinal];
+        documents.push_back({ document_data.id, document_data.rating, static_cast<int32_t>(document_data.status),
+            document_data.removed, inv_word_counts_[ordinal] });
+        for (const TermFrequency& term : document_data.terms) {
+            document_term_ids.push_back(static_cast<uint32_t>(term.term_id));
+            document_term_counts.push_back(term.count);
+        }
+        document_term_offsets.push_back(document_term_ids.size());
+    }
+    writer.WriteArray(documents.data(), documents.size());
+    writer.WriteArray(document_term_offsets.data(), document_term_offsets.size());
+    writer.WriteArray(document_term_ids.data(), document_term_ids.size());
+    writer.WriteArray(document_term_counts.data(), document_term_counts.size());
+    writer.Finish();
+}
+
+SearchServer SearchServer::LoadSnapshot(const std::string& path) {
+    const MappedFile file(path);
+    SnapshotReader reader(file);
+    const SnapshotHeader& header = reader.ReadValue<SnapshotHeader>();
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a search server snapshot "s + path);
+    }
+    if (header.version != SNAPSHOT_VERSION || header.byte_order != SNAPSHOT_BYTE_ORDER) {
+        throw std::runtime_error("Unsupported snapshot format "s + path);
+    }
+
+    SearchServer server(reader.ReadStrings(header.stop_word_count));
+    const std::vector<std::string_view> terms = reader.ReadStrings(header.term_count);
+    for (size_t term_id = 0; term_id < terms.size(); ++term_id) {
+        if (server.terms_.Intern(terms[term_id]) != term_id) {
+            throw std::runtime_error("Snapshot is corrupted"s);
+        }
+    }
+
+    const uint64_t* posting_offsets = reader.ReadArray<uint64_t>(header.term_count + 1);
+    const int32_t* term_document_freqs = reader.ReadArray<int32_t>(header.term_count);
+    const double* term_log_document_freqs = reader.ReadArray<double>(header.term_count);
+    const int32_t* posting_ordinals = reader.ReadArray<int32_t>(header.posting_count);
+    const uint32_t* posting_term_counts = reader.ReadArray<uint32_t>(header.posting_count);
+    CheckSnapshotOffsets(posting_offsets, header.term_count, header.posting_count);
+    const auto is_valid_ordinal = [&header](int32_t ordinal) {
+        return ordinal >= 0 && static_cast<uint64_t>(ordinal) < header.document_count;
+    };
+    if (!std::all_of(posting_ordinals, posting_ordinals + header.posting_count, is_valid_ordinal)) {
+        throw std::runtime_error("Snapshot is corrupted"s);
+    }
+    server.term_document_freqs_.assign(term_document_freqs, term_document_freqs + header.term_count);
+    server.term_log_document_freqs_.assign(term_log_document_freqs, term_log_document_freqs + header.term_count);
+
+    const SnapshotDocument* documents = reader.ReadArray<SnapshotDocument>(header.document_count);
+    const uint64_t* document_term_offsets = reader.ReadArray<uint64_t>(header.document_count + 1);
+    const uint32_t* document_term_ids = reader.ReadArray<uint32_t>(header.document_term_count);
+    const uint32_t* document_term_counts = reader.ReadArray<uint32_t>(header.document_term_count);
+    CheckSnapshotOffsets(document_term_offsets, header.document_count, header.document_term_count);
+    server.documents_.reserve(header.document_count);
+    server.inv_word_counts_.reserve(header.document_count);
+    for (size_t ordinal = 0; ordinal < header.document_count; ++ordinal) {
+        const SnapshotDocument& document = documents[ordinal];
+        if (document.status < 0 || document.status > static_cast<int32_t>(DocumentStatus::REMOVED)) {
+            throw std::runtime_error("Snapshot is corrupted"s);
+        }
+        DocumentData document_data = { document.id, document.rating, static_cast<DocumentStatus>(document.status),
+            document.removed != 0, {} };
+        document_data.terms.reserve(document_term_offsets[ordinal + 1] - document_term_offsets[ordinal]);
+        for (size_t i = document_term_offsets[ordinal]; i < document_term_offsets[ordinal + 1]; ++i) {
+            if (document_term_ids[i] >= header.term_count) {
+                throw std::runtime_error("Snapshot is corrupted"s);
+            }
+            document_data.terms.push_back({ document_term_ids[i], document_term_counts[i] });
+        }
+        if (!document_data.removed) {
+            if (!server.document_id_to_ordinal_.emplace(document.id, static_cast<int>(ordinal)).second) {
+                throw std::runtime_error("Snapshot is corrupted"s);
+            }
+            server.status_ordinals_[document_data.status].Add(static_cast<uint32_t>(ordinal));
+        }
+        server.documents_.push_back(std::move(document_data));
+        server.inv_word_counts_.push_back(document.inv_word_count);
+    }
+
+    // Built after the documents, their lengths give the term frequency bounds
+    server.term_postings_.resize(header.term_count);
+    for (size_t term_id = 0; term_id < header.term_count; ++term_id) {
+        PostingList& postings = server.term_postings_[term_id];
+        for (size_t i = posting_offsets[term_id]; i < posting_offsets[term_id + 1]; ++i) {
+            postings.Add(posting_ordinals[i], posting_term_counts[i], posting_term_counts[i] * server.inv_word_counts_[posting_ordinals[i]]);
+        }
+    }
+
+    server.log_document_count_ = header.log_document_count;
+    server.removed_document_count_ = header.removed_document_count;
+    server.inverse_document_freqs_frozen_ = header.inverse_document_freqs_frozen != 0;
+    server.query_evaluation_ = static_cast<QueryEvaluation>(header.query_evaluation);
+    return server;
+}
+
+MetricsSnapshot SearchServer::GetMetrics() {
+    return MetricsRegistry::GetInstance().GetSnapshot();
+}
+
+void SearchServer::DumpMetrics(std::ostream& output) {
+    GetMetrics().Dump(output);
+}
+
+SearchServer::DocumentIdIterator SearchServer::begin() const {
+    return DocumentIdIterator(documents_.begin(), documents_.end());
+}
+
+SearchServer::DocumentIdIterator SearchServer::end() const {
+    return DocumentIdIterator(documents_.end(), documents_.end());
 }
 
 bool SearchServer::IsStopWord(const std::string_view& word) const {
@@ -66,18 +625,21 @@ bool SearchServer::IsValidWord(const std::string_view& word) {
         });
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view& text) const {
-    std::vector<std::string_view> words;
-    for (const std::string_view& word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
+void SearchServer::SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const {
+    // Reused between documents, so tokenizing stops allocating after the first few of them
+    METRICS_STAGE(MetricStage::INGEST_TOKENIZATION);
+    thread_local std::vector<WordToken> tokens;
+    SplitIntoWords(text, tokens);
+    words.clear();
+    for (const WordToken& token : tokens) {
+        if (token.has_control_chars) {
+            throw std::invalid_argument("Word "s + std::string(token.word) + " is invalid"s);
         }
 
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+        if (!IsStopWord(token.word)) {
+            words.push_back(token.word);
         }
     }
-    return words;
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
@@ -105,40 +667,152 @@ SearchServer::QueryWordView SearchServer::ParseQueryWord(std::string_view& text)
         throw std::invalid_argument("Query word "s + std::string(text) + " is invalid");
     }
 
-    return { word, is_minus, IsStopWord(word) };
+    if (word.size() > 1 && word.back() == '*') {
+        return { word.substr(0, word.size() - 1), is_minus, false, true };
+    }
+    return { word, is_minus, IsStopWord(word), false };
+}
+
+// Returns nullptr for unknown and removed documents
+const SearchServer::DocumentData* SearchServer::FindDocument(int document_id) const {
+    const auto it = document_id_to_ordinal_.find(document_id);
+    return it == document_id_to_ordinal_.end() ? nullptr : &documents_[it->second];
+}
+
+const SearchServer::DocumentData& SearchServer::GetDocumentData(int document_id) const {
+    const DocumentData* document_data = FindDocument(document_id);
+    if (document_data == nullptr) {
+        throw std::out_of_range("Document "s + std::to_string(document_id) + " not found"s);
+    }
+    return *document_data;
+}
+
+// Terms of a document are sorted by id, so a word is looked up without building a word map
+bool SearchServer::ContainsTerm(const DocumentData& document_data, size_t term_id) {
+    return std::binary_search(document_data.terms.begin(), document_data.terms.end(), TermFrequency{ term_id, 0 },
+        [](const TermFrequency& lhs, const TermFrequency& rhs) {
+            return lhs.term_id < rhs.term_id;
+        });
+}
+
+// Returns TermDictionary::npos if no document contains the word
+size_t SearchServer::FindIndexedTerm(std::string_view word) const {
+    const size_t term_id = terms_.Find(word);
+    if (term_id == TermDictionary::npos || term_document_freqs_[term_id] == 0) {
+        return TermDictionary::npos;
+    }
+    return term_id;
+}
+
+double SearchServer::GetInverseDocumentFreq(size_t term_id) const {
+    return log_document_count_ - term_log_document_freqs_[term_id];
+}
+
+void SearchServer::UpdateInverseDocumentFreq(size_t term_id) {
+    const int document_freq = term_document_freqs_[term_id];
+    if (!inverse_document_freqs_frozen_ && document_freq > 0) {
+        term_log_document_freqs_[term_id] = log(document_freq);
+    }
+}
+
+void SearchServer::UpdateLogDocumentCount() {
+    const int document_count = GetDocumentCount();
+    if (!inverse_document_freqs_frozen_) {
+        log_document_count_ = document_count > 0 ? log(document_count) : 0.0;
+    }
+}
+
+SearchServer::QueryPostings SearchServer::FindQueryPostings(const QueryView& query) const {
+    QueryPostings query_postings{ std::pmr::vector<WeightedPostings>(query.GetResource()),
+        std::pmr::vector<const PostingList*>(query.GetResource()) };
+    for (std::string_view word : query.plus_words) {
+        const size_t term_id = FindIndexedTerm(word);
+        if (term_id == TermDictionary::npos) {
+            continue;
+        }
+        double inverse_document_freq = GetInverseDocumentFreq(term_id);
+        if (query.statistics != nullptr) {
+            const auto it = query.statistics->document_freqs.find(word);
+            if (it != query.statistics->document_freqs.end() && it->second > 0) {
+                inverse_document_freq = log(query.statistics->document_count) - log(it->second);
+            }
+        }
+        query_postings.plus.push_back({ &term_postings_[term_id], inverse_document_freq });
+    }
+    for (std::string_view word : query.minus_words) {
+        const size_t term_id = FindIndexedTerm(word);
+        if (term_id != TermDictionary::npos) {
+            query_postings.minus.push_back(&term_postings_[term_id]);
+        }
+    }
+    return query_postings;
 }
 
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(std::string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.find(word)->second.size());
+const RoaringBitmap& SearchServer::GetStatusOrdinals(DocumentStatus status) const {
+    static const RoaringBitmap empty_bitmap;
+    const auto it = status_ordinals_.find(status);
+    return it == status_ordinals_.end() ? empty_bitmap : it->second;
 }
 
 std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
-    std::map<std::string_view, double> map = {};
-    if (std::count(document_ids_.begin(), document_ids_.end(), document_id) == 0) {
-        return map;
+    std::map<std::string_view, double> word_freqs;
+    const DocumentData* document_data = FindDocument(document_id);
+    if (document_data == nullptr) {
+        return word_freqs;
+    }
+    const double inv_word_count = inv_word_counts_[document_data - documents_.data()];
+    for (const auto [term_id, term_count] : document_data->terms) {
+        word_freqs.emplace(terms_.GetTerm(term_id), term_count * inv_word_count);
     }
-    return document_to_word_.at(document_id);
+    return word_freqs;
 }
 
 void AddDocument(SearchServer& search_server, int document_id, const std::string& document, DocumentStatus status, const std::vector<int>& ratings) {
     search_server.AddDocument(document_id, document, status, ratings);
 }
 
-SearchServer::QueryView SearchServer::ParseQuery(std::string_view text) const {
-    QueryView result;
-    std::vector<std::string_view> splited_words = SplitIntoWords(text);
-    for (std::string_view word : splited_words) {
-        const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.insert(query_word.data);
-            }
-            else {
-                result.plus_words.insert(query_word.data);
+SearchServer::MatchQuery SearchServer::ParseMatchQuery(std::string_view text, std::pmr::memory_resource* resource) const {
+    const QueryView query = ParseQuery(text, resource);
+    const auto find_terms = [this](const std::pmr::vector<std::string_view>& words, std::pmr::vector<size_t>& term_ids) {
+        for (const std::string_view word : words) {
+            const size_t term_id = terms_.Find(word);
+            if (term_id != TermDictionary::npos) {
+                term_ids.push_back(term_id);
             }
         }
+    };
+    MatchQuery result(resource);
+    find_terms(query.plus_words, result.plus_term_ids);
+    find_terms(query.minus_words, result.minus_term_ids);
+    return result;
+}
+
+SearchServer::QueryView SearchServer::ParseQuery(std::string_view text, std::pmr::memory_resource* resource) const {
+    METRICS_STAGE(MetricStage::QUERY_PARSE);
+    thread_local std::vector<WordToken> tokens;
+    SplitIntoWords(text, tokens);
+    QueryView result(resource);
+    for (const WordToken& token : tokens) {
+        std::string_view word = token.word;
+        const auto query_word = ParseQueryWord(word);
+        if (query_word.is_stop) {
+            continue;
+        }
+        auto& words = query_word.is_minus ? result.minus_words : result.plus_words;
+        if (query_word.is_prefix) {
+            // Expanded words view the dictionary, stop words are never in it
+            terms_.ForEachWithPrefix(query_word.data, [this, &words](size_t term_id) {
+                words.push_back(terms_.GetTerm(term_id));
+                });
+        }
+        else {
+            words.push_back(query_word.data);
+        }
     }
 
+    for (auto* words : { &result.plus_words, &result.minus_words }) {
+        std::sort(words->begin(), words->end());
+        words->erase(std::unique(words->begin(), words->end()), words->end());
+    }
     return result;
 }
\ No newline at end of file
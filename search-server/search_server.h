@@ -1,92 +1,486 @@
 #pragma once
 
 #include "document.h"
+#include "metrics.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "posting_list.h"
+#include "query_arena.h"
+#include "roaring_bitmap.h"
+#include "score_accumulator.h"
+#include "term_dictionary.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <iterator>
 #include <map>
+#include <memory_resource>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <vector>
 #include <execution>
-#include <atomic>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 
 const double EPSILON = 1e-6;
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const int NUM_BASKET = 12;
+// Parallel searches split the document ordinals into blocks of at least this size
+const size_t MIN_SCORE_BLOCK_SIZE = 16 * 1024;
+const size_t SCORE_BLOCKS_PER_THREAD = 4;
+// Parallel batch ingestion gives every thread chunks of at least this many documents
+const size_t MIN_INGEST_CHUNK_SIZE = 256;
+
+// Order of search results: higher relevance first, documents within EPSILON of each other by higher rating.
+// Every server that merges results sorts with it, so they all break ties the same way
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+enum class QueryEvaluation {
+    // Scores every posting of every plus word
+    EXHAUSTIVE,
+    // Document-at-a-time MaxScore: skips documents whose score bound cannot reach the current top
+    DYNAMIC_PRUNING,
+};
+
+// Input of SearchServer::AddDocuments. The text must stay alive until the call returns
+struct NewDocument {
+    int id;
+    std::string_view text;
+    DocumentStatus status;
+    std::vector<int> ratings;
+};
+
+// Document counts of one logical corpus split across several servers. Scoring with them instead
+// of a server's own counts gives every part the IDF the whole corpus would have
+struct CorpusStatistics {
+    int document_count = 0;
+    std::map<std::string, int, std::less<>> document_freqs;
+};
+
 class SearchServer {
 public:
+    class DocumentIdIterator;
+
     template <typename StringContainer>
     explicit SearchServer(const StringContainer& stop_words);
     explicit SearchServer(const std::string& stop_words_text);
     explicit SearchServer(std::string_view stop_words_text);
 
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Tokenizes the documents in parallel and merges them into the index in one pass.
+    // If any document is invalid nothing is added, and the exception AddDocument
+    // would throw for the first invalid document is thrown
+    template <class ExecutionPolicy>
+    void AddDocuments(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents);
+    void AddDocuments(const std::vector<NewDocument>& documents);
+    // Throws what AddDocument would throw for this document, without changing the server
+    void CheckNewDocument(int document_id, std::string_view document) const;
 
+    // Removal leaves a tombstone: the document disappears from results and counts at once,
+    // its postings and no longer used terms are reclaimed by Compact
     void RemoveDocument(int document_id);
     template< class ExecutionPolicy>
     void RemoveDocument(ExecutionPolicy&& policy, int document_id);
-
+    // Rebuilds the index without removed documents. Invalidates string_views returned earlier
+    void Compact();
+    // Appends the documents of other except skipped_ids, keeping their order. Both servers
+    // must have the same stop words and no common document ids, otherwise nothing is merged
+    void MergeFrom(const SearchServer& other, const std::unordered_set<int>& skipped_ids);
+    int GetRemovedDocumentCount() const;
+
+    // top_count limits the number of returned documents, the best ones are selected without sorting the rest.
+    // A query word ending with '*' stands for every indexed word starting with the rest of it
     template <class ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
     template <class ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
     template <class ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query) const;
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+    // Writes the documents FindTopDocuments would return to output, which must have room for top_count
+    // of them, and returns their number. Lets callers fill a buffer of their own without a vector per query
+    template <class ExecutionPolicy>
+    size_t FindTopDocumentsInto(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status, Document* output,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    // Score with the given statistics instead of this server's own ones, IDF freezing is ignored
+    template <class ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, const CorpusStatistics& statistics,
+        DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, const CorpusStatistics& statistics,
+        DocumentStatus status, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    // Adds the live document count and the document frequencies of the query plus words
+    void CollectStatistics(std::string_view raw_query, CorpusStatistics& statistics) const;
 
     int GetDocumentCount() const;
-
-    std::vector<int>::iterator begin();
-    std::vector<int>::iterator end();
+    bool HasDocument(int document_id) const;
+    // Changes whenever a write may change search results, lets callers tell stale cached results
+    uint64_t GetGeneration() const;
+    // Unique among all servers of the process, a copy gets its own. Together with the generation
+    // it identifies the server contents, even after the memory of a destroyed server is reused
+    uint64_t GetInstanceId() const;
+    // Query in the form it is evaluated: sorted distinct plus words, then sorted distinct minus
+    // words with their minus, stop words dropped. Equivalent queries get equal strings
+    std::string GetCanonicalQuery(std::string_view raw_query) const;
+
+    void SetQueryEvaluation(QueryEvaluation query_evaluation);
+    QueryEvaluation GetQueryEvaluation() const;
+
+    // While frozen, AddDocument and RemoveDocument leave IDF as of the last refresh.
+    // Meant for bulk ingestion when exact per-write IDF is not needed
+    void FreezeInverseDocumentFreqs();
+    // Recomputes IDF of every term from the current document counts
+    void RefreshInverseDocumentFreqs();
+    // Refreshes IDF and resumes updating it on every write
+    void UnfreezeInverseDocumentFreqs();
+
+    // Writes the whole index, removed documents and frozen IDF included, to a binary file.
+    // The format is versioned and uses the byte order of the writing machine
+    void SaveSnapshot(const std::string& path) const;
+    // Restores a server from SaveSnapshot output. The file is memory-mapped and its arrays are
+    // copied into the index as is, documents are not tokenized again
+    static SearchServer LoadSnapshot(const std::string& path);
+
+    // Per-stage timings of all servers in the process, collected only when built with SEARCH_SERVER_METRICS
+    static MetricsSnapshot GetMetrics();
+    static void DumpMetrics(std::ostream& output);
+
+    // Ids of the stored documents in the order they were added
+    DocumentIdIterator begin() const;
+    DocumentIdIterator end() const;
 
     template< class ExecutionPolicy>
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(ExecutionPolicy&& policy, std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+    // Matches one query against many documents, e.g. the results of a search to highlight them.
+    // The query is parsed and looked up once, results follow the order of document_ids.
+    // Throws std::out_of_range before matching anything if one of the documents is not found
+    template <class ExecutionPolicy>
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+        const std::vector<int>& document_ids) const;
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::string_view raw_query,
+        const std::vector<int>& document_ids) const;
     std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
 private:
+    // Term frequency is count / document length, the length is kept once per document
+    struct TermFrequency {
+        size_t term_id;
+        uint32_t count;
+    };
     struct DocumentData {
+        int id;
         int rating;
         DocumentStatus status;
-
+        bool removed;
+        // Sorted by term id
+        std::vector<TermFrequency> terms;
     };
+
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string, std::map<int, double>, std::less<>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_;
-    std::map<int, DocumentData> documents_;
-    std::vector<int> document_ids_;
+    TermDictionary terms_;
+    // Documents are addressed by dense internal ordinals which grow with every added document.
+    // Postings of removed documents stay until Compact, so document frequencies are counted separately
+    std::vector<DocumentData> documents_;
+    // 1 / word count of every document by ordinal, multiplies term counts during scoring
+    std::vector<double> inv_word_counts_;
+    std::unordered_map<int, int> document_id_to_ordinal_;
+    std::vector<PostingList> term_postings_;
+    std::vector<int> term_document_freqs_;
+    // IDF is log_document_count_ - term_log_document_freqs_[term_id]. Only the terms of a written document
+    // change their document frequency, so a write updates O(document words) values instead of every term
+    std::vector<double> term_log_document_freqs_;
+    double log_document_count_ = 0.0;
+    bool inverse_document_freqs_frozen_ = false;
+    // Ordinals of the documents with each status, lets status searches skip other documents during traversal
+    std::map<DocumentStatus, RoaringBitmap> status_ordinals_;
+    int removed_document_count_ = 0;
+    uint64_t generation_ = 0;
+
+    // Draws a new id from a global counter on construction, copy and assignment
+    class InstanceId {
+    public:
+        InstanceId();
+        InstanceId(const InstanceId&);
+        InstanceId& operator=(const InstanceId&);
+
+        uint64_t Get() const;
+
+    private:
+        static uint64_t MakeValue();
+
+        uint64_t value_;
+    };
+
+    InstanceId instance_id_;
+    QueryEvaluation query_evaluation_ = QueryEvaluation::EXHAUSTIVE;
 
     bool IsStopWord(const std::string_view& word) const;
     static bool IsValidWord(const std::string_view& word);
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view& text) const;
+    // Fills words with the words of text except stop words, throws on a word with control characters
+    void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
     struct QueryWordView {
         std::string_view data;
         bool is_minus;
         bool is_stop;
+        // data is the prefix of a word ending with '*'
+        bool is_prefix;
     };
 
     QueryWordView ParseQueryWord(std::string_view& text) const;
 
+    // Temporary containers of a query live in the memory resource of its QueryArena scope
     struct QueryView {
-        std::set<std::string_view> plus_words;
-        std::set<std::string_view> minus_words;
+        explicit QueryView(std::pmr::memory_resource* resource)
+            : plus_words(resource)
+            , minus_words(resource) {
+        }
+
+        // Sorted and distinct: queries are short, so a sorted vector is cheaper than a tree
+        std::pmr::vector<std::string_view> plus_words;
+        std::pmr::vector<std::string_view> minus_words;
+        // Overrides the server's own IDF when set
+        const CorpusStatistics* statistics = nullptr;
+
+        std::pmr::memory_resource* GetResource() const {
+            return plus_words.get_allocator().resource();
+        }
     };
 
-    QueryView ParseQuery(std::string_view text) const;
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    struct WeightedPostings {
+        const PostingList* postings;
+        double inverse_document_freq;
+    };
 
+    struct QueryPostings {
+        std::pmr::vector<WeightedPostings> plus;
+        std::pmr::vector<const PostingList*> minus;
+    };
+
+    // Query words resolved to term ids, so matching a document takes only binary searches in its terms
+    struct MatchQuery {
+        explicit MatchQuery(std::pmr::memory_resource* resource)
+            : plus_term_ids(resource)
+            , minus_term_ids(resource) {
+        }
+
+        // In the order of the query words, words no document ever had are dropped
+        std::pmr::vector<size_t> plus_term_ids;
+        std::pmr::vector<size_t> minus_term_ids;
+    };
+
+    QueryView ParseQuery(std::string_view text, std::pmr::memory_resource* resource) const;
+    MatchQuery ParseMatchQuery(std::string_view text, std::pmr::memory_resource* resource) const;
+    const DocumentData* FindDocument(int document_id) const;
+    // Throws std::out_of_range if there is no such document
+    const DocumentData& GetDocumentData(int document_id) const;
+    static bool ContainsTerm(const DocumentData& document_data, size_t term_id);
+    // Returned words view the dictionary, so they stay valid after the query text is gone
+    template <class ExecutionPolicy>
+    std::vector<std::string_view> MatchWords(ExecutionPolicy&& policy, const MatchQuery& query, const DocumentData& document_data) const;
+    size_t FindIndexedTerm(std::string_view word) const;
+    double GetInverseDocumentFreq(size_t term_id) const;
+    void UpdateInverseDocumentFreq(size_t term_id);
+    void UpdateLogDocumentCount();
+    QueryPostings FindQueryPostings(const QueryView& query) const;
+
+    // Predicate of the status overloads. It is recognized by type and checked against
+    // status_ordinals_ before scoring, other predicates are called for every matched document
+    struct StatusFilter {
+        DocumentStatus status;
+
+        bool operator()(int, DocumentStatus document_status, int) const {
+            return document_status == status;
+        }
+    };
+
+    template <typename DocumentPredicate>
+    static constexpr bool IS_STATUS_FILTER = std::is_same_v<DocumentPredicate, StatusFilter>;
+
+    const RoaringBitmap& GetStatusOrdinals(DocumentStatus status) const;
+
+    template <class ExecutionPolicy>
+    size_t GetScoreBlockCount() const;
+    template <class ExecutionPolicy>
+    static size_t GetIngestChunkCount(size_t document_count);
+
+    // Index of a contiguous part of an AddDocuments batch, built by one thread with local term ids
+    struct IngestChunk {
+        size_t first_document = 0;
+        size_t last_document = 0;
+        std::unordered_map<std::string_view, size_t> term_ids;
+        std::vector<std::string_view> terms;
+        // Per local term: ordinals and counts in ascending ordinal order
+        std::vector<std::vector<std::pair<int, uint32_t>>> postings;
+        // Per document of the chunk, local term ids
+        std::vector<std::vector<TermFrequency>> document_terms;
+        std::vector<double> inv_word_counts;
+        std::vector<std::exception_ptr> errors;
+        std::vector<size_t> global_term_ids;
+    };
+
+    void IndexIngestChunk(const std::vector<NewDocument>& documents, int first_ordinal, IngestChunk& chunk) const;
+    void CheckNewDocuments(const std::vector<NewDocument>& documents, const std::vector<IngestChunk>& chunks) const;
+    // Returns for every global term touched by the batch the chunks and local ids holding its postings
+    std::vector<std::pair<size_t, std::vector<std::pair<size_t, size_t>>>> InternIngestTerms(std::vector<IngestChunk>& chunks);
+
+    // The best top_count documents in order, on the arena of the caller's scope
+    template <class ExecutionPolicy, typename DocumentPredicate>
+    std::pmr::vector<Document> SelectTopDocuments(ExecutionPolicy&& policy, QueryView& query, DocumentPredicate document_predicate,
+        size_t top_count) const;
     template <class ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, QueryView& query, DocumentPredicate document_predicate) const;
+    std::pmr::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, QueryView& query, DocumentPredicate document_predicate) const;
+    // Returns a superset of the best top_count documents, scoring as few postings as possible
+    template <class ExecutionPolicy, typename DocumentPredicate>
+    std::pmr::vector<Document> FindTopCandidates(ExecutionPolicy&& policy, QueryView& query, DocumentPredicate document_predicate,
+        size_t top_count) const;
+    template <typename DocumentPredicate>
+    void FindTopCandidatesInBlock(const QueryPostings& query_postings, int first_ordinal, int last_ordinal,
+        DocumentPredicate& document_predicate, const RoaringBitmap* eligible_ordinals, size_t top_count,
+        std::pmr::vector<Document>& top_documents) const;
+    // Blocks scored by other threads cannot allocate from the arena of the calling thread
+    template <class ExecutionPolicy>
+    std::pmr::memory_resource* GetBlockResource(size_t block_count, std::pmr::memory_resource* query_resource) const;
 };
 
+class SearchServer::DocumentIdIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = int;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const int*;
+    using reference = const int&;
+
+    reference operator*() const {
+        return it_->id;
+    }
+
+    pointer operator->() const {
+        return &it_->id;
+    }
+
+    DocumentIdIterator& operator++() {
+        ++it_;
+        SkipRemoved();
+        return *this;
+    }
+
+    DocumentIdIterator operator++(int) {
+        DocumentIdIterator result = *this;
+        ++*this;
+        return result;
+    }
+
+    bool operator==(const DocumentIdIterator& other) const {
+        return it_ == other.it_;
+    }
+
+    bool operator!=(const DocumentIdIterator& other) const {
+        return it_ != other.it_;
+    }
+
+private:
+    friend class SearchServer;
+    using DataIterator = std::vector<DocumentData>::const_iterator;
+
+    DocumentIdIterator(DataIterator it, DataIterator end)
+        : it_(it)
+        , end_(end) {
+        SkipRemoved();
+    }
+
+    void SkipRemoved() {
+        while (it_ != end_ && it_->removed) {
+            ++it_;
+        }
+    }
+
+    DataIterator it_;
+    DataIterator end_;
+};
+
+template <class ExecutionPolicy>
+void SearchServer::AddDocuments(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents) {
+    const int first_ordinal = static_cast<int>(documents_.size());
+    const size_t chunk_count = GetIngestChunkCount<ExecutionPolicy>(documents.size());
+    std::vector<IngestChunk> chunks(chunk_count);
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        chunks[chunk].first_document = documents.size() * chunk / chunk_count;
+        chunks[chunk].last_document = documents.size() * (chunk + 1) / chunk_count;
+    }
+
+    // Tokenization and per-chunk indexes, the server is not modified yet
+    for_each(policy, chunks.begin(), chunks.end(), [this, &documents, first_ordinal](IngestChunk& chunk) {
+        IndexIngestChunk(documents, first_ordinal, chunk);
+        });
+    CheckNewDocuments(documents, chunks);
+
+    // Dictionary is shared, so only distinct terms of every chunk are interned serially
+    const auto term_sources = InternIngestTerms(chunks);
+
+    documents_.resize(documents_.size() + documents.size());
+    inv_word_counts_.resize(documents_.size());
+    for_each(policy, chunks.begin(), chunks.end(), [this, &documents, first_ordinal](IngestChunk& chunk) {
+        for (size_t i = chunk.first_document; i < chunk.last_document; ++i) {
+            const NewDocument& document = documents[i];
+            std::vector<TermFrequency>& document_terms = chunk.document_terms[i - chunk.first_document];
+            for (TermFrequency& term : document_terms) {
+                term.term_id = chunk.global_term_ids[term.term_id];
+            }
+            std::sort(document_terms.begin(), document_terms.end(), [](const TermFrequency& lhs, const TermFrequency& rhs) {
+                return lhs.term_id < rhs.term_id;
+                });
+            documents_[first_ordinal + i] = { document.id, ComputeAverageRating(document.ratings), document.status, false,
+                std::move(document_terms) };
+            inv_word_counts_[first_ordinal + i] = chunk.inv_word_counts[i - chunk.first_document];
+        }
+        });
+
+    // Chunks cover ascending ordinal ranges, appending them in chunk order keeps every posting list sorted
+    for_each(policy, term_sources.begin(), term_sources.end(), [this, &chunks](const auto& term_source) {
+        const auto& [term_id, sources] = term_source;
+        PostingList& postings = term_postings_[term_id];
+        for (const auto& [chunk, local_term_id] : sources) {
+            const auto& chunk_postings = chunks[chunk].postings[local_term_id];
+            for (const auto& [ordinal, term_count] : chunk_postings) {
+                postings.Add(ordinal, term_count, term_count * inv_word_counts_[ordinal]);
+            }
+            term_document_freqs_[term_id] += static_cast<int>(chunk_postings.size());
+        }
+        UpdateInverseDocumentFreq(term_id);
+        });
+
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const int ordinal = first_ordinal + static_cast<int>(i);
+        document_id_to_ordinal_.emplace(documents[i].id, ordinal);
+        status_ordinals_[documents[i].status].Add(ordinal);
+    }
+    UpdateLogDocumentCount();
+    ++generation_;
+}
+
+template <class ExecutionPolicy>
+size_t SearchServer::GetIngestChunkCount(size_t document_count) {
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        return 1;
+    }
+    else {
+        const size_t max_chunk_count = std::max(1u, std::thread::hardware_concurrency()) * SCORE_BLOCKS_PER_THREAD;
+        return std::clamp<size_t>(document_count / MIN_INGEST_CHUNK_SIZE, 1, max_chunk_count);
+    }
+}
+
 template <typename StringContainer>
 SearchServer::SearchServer(const StringContainer& stop_words)
     : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
@@ -98,49 +492,81 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 
 template< class ExecutionPolicy>
 void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id) {
-    std::map<std::string_view, double> word_freq = GetWordFrequencies(document_id);
-    std::vector<std::pair<std::string_view, double>> word_freq_vec(word_freq.begin(), word_freq.end());
-    for_each(policy, word_freq_vec.begin(), word_freq_vec.end(), [this, document_id](auto& pair) {
-        word_to_document_freqs_.find(pair.first)->second.erase(document_id);
-        });
-
-    auto remove_it = find(policy, document_ids_.begin(), document_ids_.end(), document_id);
-    if (remove_it != document_ids_.end()) {
-        document_ids_.erase(remove_it);
+    const auto ordinal_it = document_id_to_ordinal_.find(document_id);
+    if (ordinal_it == document_id_to_ordinal_.end()) {
+        return;
     }
+    const int ordinal = ordinal_it->second;
+    DocumentData& document_data = documents_[ordinal];
+    document_data.removed = true;
+    document_id_to_ordinal_.erase(ordinal_it);
+    status_ordinals_[document_data.status].Remove(ordinal);
+    ++removed_document_count_;
+
+    for_each(policy, document_data.terms.begin(), document_data.terms.end(), [this](const TermFrequency& term) {
+        --term_document_freqs_[term.term_id];
+        UpdateInverseDocumentFreq(term.term_id);
+        });
+    UpdateLogDocumentCount();
+    ++generation_;
+}
 
-    auto remove_doc_it = documents_.find(document_id);
-    if (remove_doc_it != documents_.end()) {
-        documents_.erase(remove_doc_it);
-    }
+template <class ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t top_count) const {
+    const QueryArena::Scope scope(QueryArena::ForCurrentThread());
+    auto query = ParseQuery(raw_query, scope.GetResource());
+    const auto top_documents = SelectTopDocuments(policy, query, document_predicate, top_count);
+    return { top_documents.begin(), top_documents.end() };
 }
 
 template <class ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    auto query = ParseQuery(raw_query);
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, const CorpusStatistics& statistics,
+    DocumentPredicate document_predicate, size_t top_count) const {
+    const QueryArena::Scope scope(QueryArena::ForCurrentThread());
+    auto query = ParseQuery(raw_query, scope.GetResource());
+    query.statistics = &statistics;
+    const auto top_documents = SelectTopDocuments(policy, query, document_predicate, top_count);
+    return { top_documents.begin(), top_documents.end() };
+}
 
-    sort(policy, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-            return lhs.rating > rhs.rating;
-        }
-        else {
-            return lhs.relevance > rhs.relevance;
-        }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
+template <class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, const CorpusStatistics& statistics,
+    DocumentStatus status, size_t top_count) const {
+    return FindTopDocuments(policy, raw_query, statistics, StatusFilter{ status }, top_count);
+}
+
+template <class ExecutionPolicy>
+size_t SearchServer::FindTopDocumentsInto(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status, Document* output,
+    size_t top_count) const {
+    const QueryArena::Scope scope(QueryArena::ForCurrentThread());
+    auto query = ParseQuery(raw_query, scope.GetResource());
+    const auto top_documents = SelectTopDocuments(policy, query, StatusFilter{ status }, top_count);
+    std::copy(top_documents.begin(), top_documents.end(), output);
+    return top_documents.size();
+}
 
+template <class ExecutionPolicy, typename DocumentPredicate>
+std::pmr::vector<Document> SearchServer::SelectTopDocuments(ExecutionPolicy&& policy, QueryView& query, DocumentPredicate document_predicate,
+    size_t top_count) const {
+    auto matched_documents = query_evaluation_ == QueryEvaluation::DYNAMIC_PRUNING
+        ? FindTopCandidates(policy, query, document_predicate, top_count)
+        : FindAllDocuments(policy, query, document_predicate);
+
+    // Heap-based selection: O(n log k) instead of sorting every matched document
+    const auto top_end = matched_documents.begin() + std::min(top_count, matched_documents.size());
+    {
+        METRICS_STAGE(MetricStage::TOP_K_SELECTION);
+        std::partial_sort(policy, matched_documents.begin(), top_end, matched_documents.end(), IsMoreRelevant);
+    }
+    matched_documents.erase(top_end, matched_documents.end());
     return matched_documents;
 }
 
 template <class ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query,
-        [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status,
+    size_t top_count) const {
+    return FindTopDocuments(policy, raw_query, StatusFilter{ status }, top_count);
 }
 
 template <class ExecutionPolicy>
@@ -149,73 +575,313 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, s
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t top_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_count);
 }
 
 template< class ExecutionPolicy>
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(ExecutionPolicy&& policy, std::string_view raw_query, int document_id) const {
-    auto query = ParseQuery(raw_query);
-    std::vector<std::string_view> matched_words;
-    std::map<std::string_view, double> word_freq = GetWordFrequencies(document_id);
+    const QueryArena::Scope scope(QueryArena::ForCurrentThread());
+    const MatchQuery query = ParseMatchQuery(raw_query, scope.GetResource());
+    const DocumentData& document_data = GetDocumentData(document_id);
+    return { MatchWords(policy, query, document_data), document_data.status };
+}
+
+template <class ExecutionPolicy>
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(ExecutionPolicy&& policy,
+    std::string_view raw_query, const std::vector<int>& document_ids) const {
+    const QueryArena::Scope scope(QueryArena::ForCurrentThread());
+    const MatchQuery query = ParseMatchQuery(raw_query, scope.GetResource());
+    std::pmr::vector<const DocumentData*> documents(scope.GetResource());
+    documents.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        documents.push_back(&GetDocumentData(document_id));
+    }
 
-    for (std::string_view word : query.minus_words) {
-        if (word_freq.count(word) > 0) {
-            return { matched_words, documents_.at(document_id).status };
+    // Every document is matched into its own result, so parallel matching needs no synchronization
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> results(documents.size());
+    std::transform(policy, documents.begin(), documents.end(), results.begin(), [this, &query](const DocumentData* document_data) {
+        return std::tuple{ MatchWords(std::execution::seq, query, *document_data), document_data->status };
+        });
+    return results;
+}
+
+template <class ExecutionPolicy>
+std::vector<std::string_view> SearchServer::MatchWords(ExecutionPolicy&& policy, const MatchQuery& query, const DocumentData& document_data) const {
+    const auto contains_term = [&document_data](size_t term_id) {
+        return ContainsTerm(document_data, term_id);
+    };
+    if (std::any_of(query.minus_term_ids.begin(), query.minus_term_ids.end(), contains_term)) {
+        return {};
+    }
+
+    // Words are gathered on the arena of the thread, so the result is allocated once with its final size.
+    // MatchDocuments calls this from several threads, the arena of the query belongs to one of them
+    const QueryArena::Scope scope(QueryArena::ForCurrentThread());
+    std::pmr::vector<std::string_view> matched_words(scope.GetResource());
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        for (const size_t term_id : query.plus_term_ids) {
+            if (contains_term(term_id)) {
+                matched_words.push_back(terms_.GetTerm(term_id));
+            }
+        }
+    }
+    else {
+        // Each word gets its own flag, the matched words are then collected in query order
+        std::pmr::vector<char> is_matched(query.plus_term_ids.size(), scope.GetResource());
+        std::transform(policy, query.plus_term_ids.begin(), query.plus_term_ids.end(), is_matched.begin(), contains_term);
+        for (size_t i = 0; i < is_matched.size(); ++i) {
+            if (is_matched[i]) {
+                matched_words.push_back(terms_.GetTerm(query.plus_term_ids[i]));
+            }
         }
     }
-    std::vector<std::string_view> plus_words(query.plus_words.begin(), query.plus_words.end());
-    matched_words = CopyIfUnordered(policy, plus_words, [&word_freq](const std::string_view& word) { return word_freq.count(word) > 0; });
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words.begin(), matched_words.end() };
+}
+
+template <class ExecutionPolicy>
+size_t SearchServer::GetScoreBlockCount() const {
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        return 1;
+    }
+    else {
+        const size_t max_block_count = std::max(1u, std::thread::hardware_concurrency()) * SCORE_BLOCKS_PER_THREAD;
+        return std::clamp<size_t>(documents_.size() / MIN_SCORE_BLOCK_SIZE, 1, max_block_count);
+    }
+}
+
+template <class ExecutionPolicy>
+std::pmr::memory_resource* SearchServer::GetBlockResource(size_t block_count, std::pmr::memory_resource* query_resource) const {
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        return query_resource;
+    }
+    else {
+        return block_count == 1 ? query_resource : std::pmr::new_delete_resource();
+    }
 }
 
 template <class ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&& policy, QueryView& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance_concurrent(NUM_BASKET);
-    std::vector<std::string_view> plus_words(query.plus_words.begin(), query.plus_words.end());
-    for_each(policy, plus_words.begin(), plus_words.end(), [this, &document_predicate, &document_to_relevance_concurrent](std::string_view word) {
-        if (word_to_document_freqs_.count(word) > 0) {
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.find(word)->second) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance_concurrent[document_id].ref_to_value += term_freq * inverse_document_freq;
-                }
+std::pmr::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&& policy, QueryView& query, DocumentPredicate document_predicate) const {
+    const QueryPostings query_postings = FindQueryPostings(query);
+    const RoaringBitmap* eligible_ordinals = nullptr;
+    if constexpr (IS_STATUS_FILTER<DocumentPredicate>) {
+        eligible_ordinals = &GetStatusOrdinals(document_predicate.status);
+    }
+
+    // Every block of ordinals is scored by one thread in its own dense accumulator,
+    // so partial scores never need locking or merging
+    const size_t ordinal_count = documents_.size();
+    const size_t block_count = GetScoreBlockCount<ExecutionPolicy>();
+    std::pmr::vector<std::pmr::vector<Document>> block_documents(block_count,
+        GetBlockResource<ExecutionPolicy>(block_count, query.GetResource()));
+    std::pmr::vector<size_t> blocks(block_count, query.GetResource());
+    std::iota(blocks.begin(), blocks.end(), 0);
+    for_each(policy, blocks.begin(), blocks.end(), [&](size_t block) {
+        const int first_ordinal = static_cast<int>(ordinal_count * block / block_count);
+        const int last_ordinal = static_cast<int>(ordinal_count * (block + 1) / block_count);
+        ScoreAccumulator& accumulator = ScoreAccumulator::ForCurrentThread();
+        accumulator.Reset(last_ordinal - first_ordinal);
+
+        {
+            METRICS_STAGE(MetricStage::MINUS_WORD_FILTER);
+            for (const PostingList* postings : query_postings.minus) {
+                postings->ForEach(first_ordinal, last_ordinal, [&](int ordinal, uint32_t) {
+                    accumulator.Exclude(ordinal - first_ordinal);
+                    });
+            }
+        }
+        {
+            METRICS_STAGE(MetricStage::POSTING_TRAVERSAL);
+            for (const auto [postings, inverse_document_freq] : query_postings.plus) {
+                postings->ForEach(first_ordinal, last_ordinal, [&, inverse_document_freq = inverse_document_freq](int ordinal, uint32_t term_count) {
+                    if constexpr (IS_STATUS_FILTER<DocumentPredicate>) {
+                        if (!eligible_ordinals->Contains(ordinal)) {
+                            return;
+                        }
+                    }
+                    accumulator.Add(ordinal - first_ordinal, term_count * inv_word_counts_[ordinal] * inverse_document_freq);
+                    });
             }
         }
+
+        METRICS_STAGE(MetricStage::ACCUMULATOR_MERGE);
+        std::pmr::vector<Document>& matched_documents = block_documents[block];
+        accumulator.ForEachMatched([&](size_t slot, double relevance) {
+            const DocumentData& document_data = documents_[first_ordinal + slot];
+            if (IS_STATUS_FILTER<DocumentPredicate>
+                || (!document_data.removed && document_predicate(document_data.id, document_data.status, document_data.rating))) {
+                matched_documents.push_back({ document_data.id, relevance, document_data.rating });
+            }
+            });
         });
-    std::map<int, double> document_to_relevance = document_to_relevance_concurrent.BuildOrdinaryMap();
 
-    for (std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    METRICS_STAGE(MetricStage::ACCUMULATOR_MERGE);
+    std::pmr::vector<Document> matched_documents(query.GetResource());
+    if (block_count == 1) {
+        matched_documents = std::move(block_documents[0]);
+    }
+    else {
+        for (const auto& documents : block_documents) {
+            matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
         }
+    }
+    return matched_documents;
+}
 
-        for (const auto [document_id, _] : word_to_document_freqs_.find(word)->second) {
-            document_to_relevance.erase(document_id);
-        }
+template <class ExecutionPolicy, typename DocumentPredicate>
+std::pmr::vector<Document> SearchServer::FindTopCandidates(ExecutionPolicy&& policy, QueryView& query, DocumentPredicate document_predicate,
+    size_t top_count) const {
+    const QueryPostings query_postings = FindQueryPostings(query);
+    const RoaringBitmap* eligible_ordinals = nullptr;
+    if constexpr (IS_STATUS_FILTER<DocumentPredicate>) {
+        eligible_ordinals = &GetStatusOrdinals(document_predicate.status);
     }
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+    // Each block keeps its own top, the final selection is made from their union
+    const size_t ordinal_count = documents_.size();
+    const size_t block_count = GetScoreBlockCount<ExecutionPolicy>();
+    std::pmr::vector<std::pmr::vector<Document>> block_documents(block_count,
+        GetBlockResource<ExecutionPolicy>(block_count, query.GetResource()));
+    std::pmr::vector<size_t> blocks(block_count, query.GetResource());
+    std::iota(blocks.begin(), blocks.end(), 0);
+    for_each(policy, blocks.begin(), blocks.end(), [&](size_t block) {
+        const int first_ordinal = static_cast<int>(ordinal_count * block / block_count);
+        const int last_ordinal = static_cast<int>(ordinal_count * (block + 1) / block_count);
+        FindTopCandidatesInBlock(query_postings, first_ordinal, last_ordinal, document_predicate, eligible_ordinals, top_count,
+            block_documents[block]);
+        });
+
+    METRICS_STAGE(MetricStage::ACCUMULATOR_MERGE);
+    std::pmr::vector<Document> candidates(query.GetResource());
+    if (block_count == 1) {
+        candidates = std::move(block_documents[0]);
     }
-    return matched_documents;
+    else {
+        for (const auto& documents : block_documents) {
+            candidates.insert(candidates.end(), documents.begin(), documents.end());
+        }
+    }
+    return candidates;
 }
 
-template <class ExecutionPolicy, typename Container, typename Predicate>
-std::vector<typename Container::value_type> CopyIfUnordered(ExecutionPolicy&& policy, const Container& container, Predicate predicate) {
-    std::vector<typename Container::value_type> result(container.size());
-    std::atomic_int size = 0;
-    for_each(
-        policy,
-        container.begin(), container.end(),
-        [predicate, &size, &result](const auto& value) {
-            if (predicate(value)) {
-                result[size++] = value;
+template <typename DocumentPredicate>
+void SearchServer::FindTopCandidatesInBlock(const QueryPostings& query_postings, int first_ordinal, int last_ordinal,
+    DocumentPredicate& document_predicate, const RoaringBitmap* eligible_ordinals, size_t top_count,
+    std::pmr::vector<Document>& top_documents) const {
+    // The block may run on a thread other than the one that parsed the query
+    const QueryArena::Scope scope(QueryArena::ForCurrentThread());
+    // Minus words are checked inside the document-at-a-time loop, so they are part of the traversal here
+    METRICS_STAGE(MetricStage::POSTING_TRAVERSAL);
+    struct Cursor {
+        PostingList::Cursor postings;
+        double inverse_document_freq;
+        double max_score;
+    };
+    auto make_cursor = [first_ordinal, last_ordinal](const PostingList& postings, double inverse_document_freq) {
+        return Cursor{ PostingList::Cursor(postings, first_ordinal, last_ordinal), inverse_document_freq,
+            postings.GetMaxTermFreq() * inverse_document_freq };
+    };
+    const auto score = [this](const Cursor& cursor, int ordinal) {
+        return cursor.postings.GetTermCount() * inv_word_counts_[ordinal] * cursor.inverse_document_freq;
+    };
+
+    std::pmr::vector<Cursor> plus_cursors(scope.GetResource());
+    for (const auto [postings, inverse_document_freq] : query_postings.plus) {
+        plus_cursors.push_back(make_cursor(*postings, inverse_document_freq));
+    }
+    std::pmr::vector<Cursor> minus_cursors(scope.GetResource());
+    for (const PostingList* postings : query_postings.minus) {
+        minus_cursors.push_back(make_cursor(*postings, 0.0));
+    }
+
+    // Cursors ordered by score bound, max_score_prefix[i] bounds the sum of the first i + 1 terms
+    std::sort(plus_cursors.begin(), plus_cursors.end(), [](const Cursor& lhs, const Cursor& rhs) {
+        return lhs.max_score < rhs.max_score;
+        });
+    std::pmr::vector<double> max_score_prefix(plus_cursors.size(), scope.GetResource());
+    double max_score_sum = 0.0;
+    for (size_t i = 0; i < plus_cursors.size(); ++i) {
+        max_score_sum += plus_cursors[i].max_score;
+        max_score_prefix[i] = max_score_sum;
+    }
+
+    // Min-heap of the best documents seen so far, its top is the weakest of them.
+    // A document can still take a place if its relevance is within EPSILON of the weakest one,
+    // because ties are broken by rating
+    double threshold = -1.0;
+    size_t first_essential = 0;
+    auto can_reach_top = [&threshold](double max_relevance) {
+        return max_relevance >= threshold - EPSILON;
+    };
+
+    while (true) {
+        // Only documents present in essential lists can reach the top,
+        // the non-essential ones together are bounded by max_score_prefix[first_essential - 1]
+        int ordinal = last_ordinal;
+        for (size_t i = first_essential; i < plus_cursors.size(); ++i) {
+            ordinal = std::min(ordinal, plus_cursors[i].postings.GetDocumentId());
+        }
+        if (ordinal == last_ordinal) {
+            break;
+        }
+
+        bool eligible = !documents_[ordinal].removed;
+        if constexpr (IS_STATUS_FILTER<DocumentPredicate>) {
+            eligible = eligible_ordinals->Contains(ordinal);
+        }
+        double relevance = 0.0;
+        for (size_t i = first_essential; i < plus_cursors.size(); ++i) {
+            Cursor& cursor = plus_cursors[i];
+            if (cursor.postings.GetDocumentId() == ordinal) {
+                relevance += score(cursor, ordinal);
+                cursor.postings.Next();
+            }
+        }
+        if (!eligible) {
+            continue;
+        }
+        bool pruned = false;
+        for (size_t i = first_essential; i-- > 0;) {
+            if (!can_reach_top(relevance + max_score_prefix[i])) {
+                pruned = true;
+                break;
+            }
+            Cursor& cursor = plus_cursors[i];
+            if (cursor.postings.SeekTo(ordinal)) {
+                relevance += score(cursor, ordinal);
+            }
+        }
+        if (pruned || !can_reach_top(relevance)) {
+            continue;
+        }
+        if (std::any_of(minus_cursors.begin(), minus_cursors.end(), [ordinal](Cursor& cursor) { return cursor.postings.SeekTo(ordinal); })) {
+            continue;
+        }
+        const DocumentData& document_data = documents_[ordinal];
+        if (!IS_STATUS_FILTER<DocumentPredicate> && !document_predicate(document_data.id, document_data.status, document_data.rating)) {
+            continue;
+        }
+
+        const Document document{ document_data.id, relevance, document_data.rating };
+        if (top_documents.size() < top_count) {
+            top_documents.push_back(document);
+            std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+        }
+        else if (top_count > 0 && IsMoreRelevant(document, top_documents.front())) {
+            std::pop_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+            top_documents.back() = document;
+            std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+        }
+        else {
+            continue;
+        }
+
+        if (top_documents.size() == top_count) {
+            threshold = top_documents.front().relevance;
+            while (first_essential < plus_cursors.size() && !can_reach_top(max_score_prefix[first_essential])) {
+                ++first_essential;
             }
         }
-    );
-    result.resize(size);
-    return result;
-}
\ No newline at end of file
+    }
+}
@@ -0,0 +1,219 @@
+#include "segmented_search_server.h"
+#include <algorithm>
+#include <numeric>
+
+SegmentedSearchServer::SegmentedSearchServer(const std::string& stop_words_text, size_t max_buffered_documents)
+    : stop_words_text_(stop_words_text)
+    , max_buffered_documents_(std::max<size_t>(max_buffered_documents, 1))
+    , state_(std::make_shared<const IndexState>())
+    , buffer_(std::make_unique<SearchServer>(stop_words_text)) {
+    merge_thread_ = std::thread([this] {
+        MergeSegments();
+        });
+}
+
+SegmentedSearchServer::~SegmentedSearchServer() {
+    {
+        std::lock_guard lock(write_mutex_);
+        stopping_ = true;
+    }
+    merge_needed_.notify_all();
+    merge_thread_.join();
+}
+
+void SegmentedSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    std::lock_guard lock(write_mutex_);
+    if (document_segments_.count(document_id) > 0) {
+        using namespace std::literals;
+        throw std::invalid_argument("Invalid document_id"s);
+    }
+    buffer_->AddDocument(document_id, document, status, ratings);
+    document_segments_.emplace(document_id, nullptr);
+    if (static_cast<size_t>(buffer_->GetDocumentCount()) >= max_buffered_documents_) {
+        RefreshLocked();
+    }
+}
+
+void SegmentedSearchServer::RemoveDocument(int document_id) {
+    std::lock_guard lock(write_mutex_);
+    const auto it = document_segments_.find(document_id);
+    if (it == document_segments_.end()) {
+        return;
+    }
+    if (it->second == nullptr) {
+        buffer_->RemoveDocument(document_id);
+    }
+    else {
+        pending_removals_[it->second].push_back(document_id);
+    }
+    document_segments_.erase(it);
+}
+
+void SegmentedSearchServer::Refresh() {
+    std::lock_guard lock(write_mutex_);
+    RefreshLocked();
+}
+
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status);
+}
+
+int SegmentedSearchServer::GetDocumentCount() const {
+    return LoadState()->document_count;
+}
+
+size_t SegmentedSearchServer::GetSegmentCount() const {
+    return LoadState()->segments.size();
+}
+
+std::shared_ptr<const SegmentedSearchServer::IndexState> SegmentedSearchServer::LoadState() const {
+    return std::atomic_load(&state_);
+}
+
+void SegmentedSearchServer::PublishState(std::shared_ptr<IndexState> state) {
+    state->document_count = 0;
+    for (const Segment& segment : state->segments) {
+        state->document_count += segment.index->GetDocumentCount() - static_cast<int>(segment.removed_ids->size());
+    }
+    const bool merge_needed = state->segments.size() > MAX_SEGMENT_COUNT;
+    std::atomic_store(&state_, std::shared_ptr<const IndexState>(std::move(state)));
+    if (merge_needed) {
+        merge_needed_.notify_one();
+    }
+}
+
+void SegmentedSearchServer::RefreshLocked() {
+    const bool has_buffered_documents = buffer_->GetDocumentCount() > 0;
+    if (!has_buffered_documents && pending_removals_.empty()) {
+        return;
+    }
+
+    auto state = std::make_shared<IndexState>(*LoadState());
+    for (Segment& segment : state->segments) {
+        const auto removals = pending_removals_.find(segment.index.get());
+        if (removals == pending_removals_.end()) {
+            continue;
+        }
+        // Published sets are shared with running queries, so they are copied rather than changed
+        auto removed_ids = std::make_shared<std::unordered_set<int>>(*segment.removed_ids);
+        auto removed_document_freqs = std::make_shared<DocumentFreqs>(*segment.removed_document_freqs);
+        for (const int document_id : removals->second) {
+            removed_ids->insert(document_id);
+            for (const auto& [word, freq] : segment.index->GetWordFrequencies(document_id)) {
+                ++(*removed_document_freqs)[std::string(word)];
+            }
+        }
+        segment.removed_ids = std::move(removed_ids);
+        segment.removed_document_freqs = std::move(removed_document_freqs);
+    }
+    pending_removals_.clear();
+
+    if (has_buffered_documents) {
+        buffer_->Compact();
+        std::shared_ptr<const SearchServer> sealed = std::move(buffer_);
+        buffer_ = std::make_unique<SearchServer>(stop_words_text_);
+        for (const int document_id : *sealed) {
+            document_segments_[document_id] = sealed.get();
+        }
+        state->segments.push_back({ std::move(sealed), std::make_shared<const std::unordered_set<int>>(),
+            std::make_shared<const DocumentFreqs>() });
+    }
+    PublishState(std::move(state));
+}
+
+void SegmentedSearchServer::MergeSegments() {
+    std::unique_lock lock(write_mutex_);
+    while (true) {
+        merge_needed_.wait(lock, [this] {
+            return stopping_ || LoadState()->segments.size() > MAX_SEGMENT_COUNT;
+            });
+        if (stopping_) {
+            return;
+        }
+
+        // Merging the smallest segments keeps every document rewritten only a logarithmic number of times
+        const std::shared_ptr<const IndexState> state = LoadState();
+        std::vector<size_t> order(state->segments.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&state](size_t lhs, size_t rhs) {
+            return state->segments[lhs].index->GetDocumentCount() < state->segments[rhs].index->GetDocumentCount();
+            });
+        order.resize(std::min(SEGMENT_MERGE_FACTOR, order.size()));
+        std::vector<Segment> sources;
+        for (const size_t index : order) {
+            sources.push_back(state->segments[index]);
+        }
+
+        // Segments are immutable, so the merge itself runs without blocking writers
+        lock.unlock();
+        SearchServer merged(stop_words_text_);
+        for (const Segment& source : sources) {
+            merged.MergeFrom(*source.index, *source.removed_ids);
+        }
+        lock.lock();
+
+        // Only this thread drops segments, so the sources are still there. Removals published since
+        // the merge started are applied now, pending ones move to the merged segment
+        auto new_state = std::make_shared<IndexState>();
+        std::vector<int> pending_removals;
+        for (const Segment& segment : LoadState()->segments) {
+            const auto source = std::find_if(sources.begin(), sources.end(), [&segment](const Segment& source) {
+                return source.index == segment.index;
+                });
+            if (source == sources.end()) {
+                new_state->segments.push_back(segment);
+                continue;
+            }
+            for (const int document_id : *segment.removed_ids) {
+                if (source->removed_ids->count(document_id) == 0) {
+                    merged.RemoveDocument(document_id);
+                }
+            }
+            const auto removals = pending_removals_.find(segment.index.get());
+            if (removals != pending_removals_.end()) {
+                pending_removals.insert(pending_removals.end(), removals->second.begin(), removals->second.end());
+                pending_removals_.erase(removals);
+            }
+        }
+        merged.Compact();
+
+        auto merged_index = std::make_shared<const SearchServer>(std::move(merged));
+        for (const int document_id : *merged_index) {
+            // A document removed but not yet refreshed may have been written again into the buffer
+            const auto it = document_segments_.find(document_id);
+            if (it == document_segments_.end()) {
+                continue;
+            }
+            const bool in_source = std::any_of(sources.begin(), sources.end(), [&it](const Segment& source) {
+                return source.index.get() == it->second;
+                });
+            if (in_source) {
+                it->second = merged_index.get();
+            }
+        }
+        if (!pending_removals.empty()) {
+            pending_removals_[merged_index.get()] = std::move(pending_removals);
+        }
+        new_state->segments.push_back({ std::move(merged_index), std::make_shared<const std::unordered_set<int>>(),
+            std::make_shared<const DocumentFreqs>() });
+        PublishState(std::move(new_state));
+    }
+}
+
+CorpusStatistics SegmentedSearchServer::CollectStatistics(const IndexState& state, std::string_view raw_query) {
+    CorpusStatistics statistics;
+    for (const Segment& segment : state.segments) {
+        segment.index->CollectStatistics(raw_query, statistics);
+        statistics.document_count -= static_cast<int>(segment.removed_ids->size());
+    }
+    for (const Segment& segment : state.segments) {
+        for (auto& [word, document_freq] : statistics.document_freqs) {
+            const auto it = segment.removed_document_freqs->find(word);
+            if (it != segment.removed_document_freqs->end()) {
+                document_freq -= it->second;
+            }
+        }
+    }
+    return statistics;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include "document.h"
+#include "search_server.h"
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Sealing the write buffer merges small segments once there are more than this many
+const size_t MAX_SEGMENT_COUNT = 8;
+// Number of the smallest segments combined by one merge
+const size_t SEGMENT_MERGE_FACTOR = 4;
+
+// LSM-style index that serves queries while documents are written. Writes go to a small in-memory
+// buffer, Refresh seals it into an immutable segment and a background thread merges small segments.
+// A query pins the current list of segments without waiting for writers, and superseded segments
+// are freed when the last query using them finishes. Results are scored with corpus-wide
+// statistics, so they are the same as those of one SearchServer with the visible documents
+class SegmentedSearchServer {
+public:
+    explicit SegmentedSearchServer(const std::string& stop_words_text, size_t max_buffered_documents = 4096);
+    SegmentedSearchServer(const SegmentedSearchServer&) = delete;
+    SegmentedSearchServer& operator=(const SegmentedSearchServer&) = delete;
+    ~SegmentedSearchServer();
+
+    // Writes become visible to queries on Refresh, which also runs whenever the buffer gets full
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+    void Refresh();
+
+    template <class ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    // Counts only the documents visible to queries
+    int GetDocumentCount() const;
+    size_t GetSegmentCount() const;
+
+private:
+    using DocumentFreqs = std::map<std::string, int, std::less<>>;
+
+    struct Segment {
+        std::shared_ptr<const SearchServer> index;
+        // Documents removed after the segment was sealed and the document frequencies they still add to it
+        std::shared_ptr<const std::unordered_set<int>> removed_ids;
+        std::shared_ptr<const DocumentFreqs> removed_document_freqs;
+    };
+
+    // Never changed after publishing, a new state replaces the whole object
+    struct IndexState {
+        std::vector<Segment> segments;
+        int document_count = 0;
+    };
+
+    std::shared_ptr<const IndexState> LoadState() const;
+    void PublishState(std::shared_ptr<IndexState> state);
+    void RefreshLocked();
+    void MergeSegments();
+    static CorpusStatistics CollectStatistics(const IndexState& state, std::string_view raw_query);
+
+    template <class ExecutionPolicy, typename DocumentFilter>
+    std::vector<Document> FindTopSegmentDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentFilter document_filter,
+        size_t top_count) const;
+
+    const std::string stop_words_text_;
+    const size_t max_buffered_documents_;
+    // Read and replaced only through std::atomic_load and std::atomic_store
+    std::shared_ptr<const IndexState> state_;
+
+    // Guards the members below
+    std::mutex write_mutex_;
+    std::unique_ptr<SearchServer> buffer_;
+    // Segment of every written document, nullptr while it is in the buffer
+    std::unordered_map<int, const SearchServer*> document_segments_;
+    // Removals from sealed segments waiting for the next Refresh
+    std::map<const SearchServer*, std::vector<int>> pending_removals_;
+    std::condition_variable merge_needed_;
+    bool stopping_ = false;
+    std::thread merge_thread_;
+};
+
+template <class ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_count) const {
+    return FindTopSegmentDocuments(policy, raw_query, document_predicate, top_count);
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+    DocumentStatus status, size_t top_count) const {
+    return FindTopSegmentDocuments(policy, raw_query, status, top_count);
+}
+
+template <class ExecutionPolicy, typename DocumentFilter>
+std::vector<Document> SegmentedSearchServer::FindTopSegmentDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+    DocumentFilter document_filter, size_t top_count) const {
+    const std::shared_ptr<const IndexState> state = LoadState();
+    const CorpusStatistics statistics = CollectStatistics(*state, raw_query);
+
+    std::vector<Document> matched_documents;
+    for (const Segment& segment : state->segments) {
+        std::vector<Document> segment_documents;
+        if (segment.removed_ids->empty()) {
+            // A status still goes through the server's status fast path
+            segment_documents = segment.index->FindTopDocuments(policy, raw_query, statistics, document_filter, top_count);
+        }
+        else {
+            const auto is_visible = [&removed_ids = *segment.removed_ids, &document_filter](int document_id, DocumentStatus status, int rating) {
+                if (removed_ids.count(document_id) > 0) {
+                    return false;
+                }
+                if constexpr (std::is_same_v<DocumentFilter, DocumentStatus>) {
+                    return status == document_filter;
+                }
+                else {
+                    return static_cast<bool>(document_filter(document_id, status, rating));
+                }
+            };
+            segment_documents = segment.index->FindTopDocuments(policy, raw_query, statistics, is_visible, top_count);
+        }
+        matched_documents.insert(matched_documents.end(), segment_documents.begin(), segment_documents.end());
+    }
+
+    const auto top_end = matched_documents.begin() + std::min(top_count, matched_documents.size());
+    std::partial_sort(matched_documents.begin(), top_end, matched_documents.end(), IsMoreRelevant);
+    matched_documents.erase(top_end, matched_documents.end());
+    return matched_documents;
+}
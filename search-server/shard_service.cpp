@@ -0,0 +1,137 @@
+#include "shard_service.h"
+#include "search_protocol.h"
+#include <execution>
+#include <stdexcept>
+
+ShardService::ShardService(const SearchServer& server, const std::string& endpoint)
+    : server_(server)
+    , listener_(endpoint) {
+}
+
+ShardService::~ShardService() {
+    Stop();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+void ShardService::Run() {
+    while (true) {
+        Connection connection = listener_.Accept();
+        JoinFinishedThreads();
+        std::lock_guard lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        if (connection.IsOpen()) {
+            const ThreadList::iterator thread = threads_.emplace(threads_.end());
+            *thread = std::thread([this, thread, connection = std::move(connection)]() mutable {
+                ServeConnection(std::move(connection));
+                std::lock_guard lock(mutex_);
+                finished_threads_.push_back(thread);
+                });
+        }
+    }
+}
+
+void ShardService::Stop() {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+    listener_.Shutdown();
+    for (Connection* connection : connections_) {
+        connection->Shutdown();
+    }
+}
+
+void ShardService::ServeConnection(Connection connection) {
+    {
+        std::lock_guard lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        connections_.insert(&connection);
+    }
+    std::string buffer;
+    std::string message;
+    try {
+        while (connection.Receive(buffer, true)) {
+            while (ExtractMessage(buffer, message)) {
+                connection.SendAll(HandleRequest(message));
+            }
+        }
+    }
+    catch (const std::runtime_error&) {
+        // A broken or closed stream ends only this connection
+    }
+    std::lock_guard lock(mutex_);
+    connections_.erase(&connection);
+}
+
+void ShardService::JoinFinishedThreads() {
+    ThreadList finished;
+    {
+        std::lock_guard lock(mutex_);
+        for (const ThreadList::iterator thread : finished_threads_) {
+            finished.splice(finished.end(), threads_, thread);
+        }
+        finished_threads_.clear();
+    }
+    // A finished thread only has to return from its function, so these joins do not wait long
+    for (std::thread& thread : finished) {
+        thread.join();
+    }
+}
+
+std::string ShardService::HandleRequest(std::string_view message) const {
+    const auto make_error = [](ErrorKind kind, const std::exception& e) {
+        MessageWriter writer(MessageType::ERROR);
+        writer.WriteValue(kind);
+        writer.WriteString(e.what());
+        return writer.Finish();
+    };
+
+    try {
+        MessageReader reader(message);
+        switch (reader.GetType()) {
+        case MessageType::COLLECT_STATISTICS: {
+            CorpusStatistics statistics;
+            server_.CollectStatistics(reader.ReadString(), statistics);
+            MessageWriter writer(MessageType::STATISTICS);
+            writer.WriteStatistics(statistics);
+            return writer.Finish();
+        }
+        case MessageType::FIND_TOP_DOCUMENTS: {
+            const std::string_view raw_query = reader.ReadString();
+            const auto status = reader.ReadValue<DocumentStatus>();
+            const auto top_count = reader.ReadValue<uint32_t>();
+            const CorpusStatistics statistics = reader.ReadStatistics();
+            MessageWriter writer(MessageType::DOCUMENTS);
+            writer.WriteDocuments(server_.FindTopDocuments(std::execution::par, raw_query, statistics, status, top_count));
+            return writer.Finish();
+        }
+        case MessageType::MATCH_DOCUMENT: {
+            const std::string_view raw_query = reader.ReadString();
+            const auto document_id = reader.ReadValue<int32_t>();
+            const auto [words, status] = server_.MatchDocument(raw_query, document_id);
+            MessageWriter writer(MessageType::MATCHED_WORDS);
+            writer.WriteValue(status);
+            writer.WriteValue(static_cast<uint32_t>(words.size()));
+            for (std::string_view word : words) {
+                writer.WriteString(word);
+            }
+            return writer.Finish();
+        }
+        default:
+            throw std::runtime_error("Unexpected request type " + std::to_string(static_cast<int>(reader.GetType())));
+        }
+    }
+    catch (const std::invalid_argument& e) {
+        return make_error(ErrorKind::INVALID_ARGUMENT, e);
+    }
+    catch (const std::out_of_range& e) {
+        return make_error(ErrorKind::OUT_OF_RANGE, e);
+    }
+    catch (const std::exception& e) {
+        return make_error(ErrorKind::INTERNAL, e);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "search_server.h"
+#include "socket_connection.h"
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Answers SearchCoordinator requests for one SearchServer over a stream socket. Every connection
+// is served by its own thread, which is joined soon after the connection closes; the server
+// is only read, so it must not be written meanwhile
+class ShardService {
+public:
+    ShardService(const SearchServer& server, const std::string& endpoint);
+    ShardService(const ShardService&) = delete;
+    ShardService& operator=(const ShardService&) = delete;
+    ~ShardService();
+
+    // Accepts connections until Stop is called from another thread
+    void Run();
+    // Closes the listener and the open connections, Run returns soon after
+    void Stop();
+
+private:
+    using ThreadList = std::list<std::thread>;
+
+    void ServeConnection(Connection connection);
+    // Joins the threads of the connections closed so far
+    void JoinFinishedThreads();
+    std::string HandleRequest(std::string_view message) const;
+
+    const SearchServer& server_;
+    Listener listener_;
+
+    // Guards the members below
+    std::mutex mutex_;
+    bool stopping_ = false;
+    std::unordered_set<Connection*> connections_;
+    // Threads of open connections, and of closed ones until they are joined
+    ThreadList threads_;
+    std::vector<ThreadList::iterator> finished_threads_;
+};
@@ -0,0 +1,99 @@
+#include "sharded_search_server.h"
+#include <exception>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace std::literals;
+
+ShardedSearchServer::ShardedSearchServer(const std::string& stop_words_text, size_t shard_count)
+    : shards_(std::max<size_t>(shard_count, 1), SearchServer(stop_words_text))
+    , executor_(shards_.size()) {
+}
+
+void ShardedSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    // Ids of all shards are distinct because a document id always maps to the same shard
+    shards_[GetShard(document_id)].AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    std::vector<std::vector<size_t>> shard_indexes(shards_.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        shard_indexes[GetShard(documents[i].id)].push_back(i);
+    }
+
+    // The whole batch is checked before any shard changes, so the error is the one of the first invalid document
+    std::vector<std::exception_ptr> errors(documents.size());
+    executor_.ParallelFor(shards_.size(), [&](size_t shard, size_t) {
+        std::unordered_set<int> batch_ids;
+        for (const size_t i : shard_indexes[shard]) {
+            try {
+                if (!batch_ids.insert(documents[i].id).second) {
+                    throw std::invalid_argument("Invalid document_id"s);
+                }
+                shards_[shard].CheckNewDocument(documents[i].id, documents[i].text);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+        });
+    for (const std::exception_ptr& error : errors) {
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    std::vector<std::vector<NewDocument>> shard_documents(shards_.size());
+    for (size_t shard = 0; shard < shards_.size(); ++shard) {
+        shard_documents[shard].reserve(shard_indexes[shard].size());
+        for (const size_t i : shard_indexes[shard]) {
+            shard_documents[shard].push_back(documents[i]);
+        }
+    }
+    ForEachShard(std::execution::par, [&](size_t shard) {
+        shards_[shard].AddDocuments(std::execution::seq, shard_documents[shard]);
+        });
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    shards_[GetShard(document_id)].RemoveDocument(document_id);
+}
+
+void ShardedSearchServer::Compact() {
+    executor_.ParallelFor(shards_.size(), [this](size_t shard, size_t) {
+        shards_[shard].Compact();
+        });
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(std::string_view raw_query,
+    int document_id) const {
+    return shards_[GetShard(document_id)].MatchDocument(raw_query, document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+    for (const SearchServer& shard : shards_) {
+        document_count += shard.GetDocumentCount();
+    }
+    return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+void ShardedSearchServer::SetQueryEvaluation(QueryEvaluation query_evaluation) {
+    for (SearchServer& shard : shards_) {
+        shard.SetQueryEvaluation(query_evaluation);
+    }
+}
+
+// Negative ids get a shard too, which rejects them like SearchServer does
+size_t ShardedSearchServer::GetShard(int document_id) const {
+    return static_cast<size_t>(static_cast<unsigned int>(document_id)) % shards_.size();
+}
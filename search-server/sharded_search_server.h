@@ -0,0 +1,110 @@
+#pragma once
+#include "document.h"
+#include "query_executor.h"
+#include "search_server.h"
+#include <algorithm>
+#include <execution>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// Index split by document id into independent SearchServer shards, each served by its own worker of a
+// private QueryExecutor: batches are ingested and parallel queries are answered by all shards at once.
+// Queries are scored with the document frequencies of all shards, so the results are the same as those
+// of one SearchServer with every document. Like SearchServer, it must not be written while it is read
+class ShardedSearchServer {
+public:
+    explicit ShardedSearchServer(const std::string& stop_words_text,
+        size_t shard_count = std::max(1u, std::thread::hardware_concurrency()));
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Every shard indexes its part of the batch on its own worker. If any document is invalid
+    // nothing is added, and the exception AddDocument would throw for the first invalid document is thrown
+    void AddDocuments(const std::vector<NewDocument>& documents);
+    void RemoveDocument(int document_id);
+    void Compact();
+
+    // The parallel policy fans the query out to the shard workers, the sequential one searches
+    // the shards in the calling thread. Both merge the top_count best documents of every shard
+    template <class ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+    size_t GetShardCount() const;
+    void SetQueryEvaluation(QueryEvaluation query_evaluation);
+
+private:
+    size_t GetShard(int document_id) const;
+
+    // Calls task(shard) for every shard, on the shard workers unless the policy is sequenced
+    template <class ExecutionPolicy, typename Task>
+    void ForEachShard(ExecutionPolicy&& policy, Task task) const;
+    template <class ExecutionPolicy, typename DocumentFilter>
+    std::vector<Document> FindTopShardDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentFilter document_filter,
+        size_t top_count) const;
+
+    std::vector<SearchServer> shards_;
+    // Parallel calls from several threads take turns on the workers
+    mutable QueryExecutor executor_;
+};
+
+template <class ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_count) const {
+    return FindTopShardDocuments(policy, raw_query, document_predicate, top_count);
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+    DocumentStatus status, size_t top_count) const {
+    return FindTopShardDocuments(policy, raw_query, status, top_count);
+}
+
+template <class ExecutionPolicy, typename Task>
+void ShardedSearchServer::ForEachShard(ExecutionPolicy&&, Task task) const {
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        for (size_t shard = 0; shard < shards_.size(); ++shard) {
+            task(shard);
+        }
+    }
+    else {
+        // With as many indexes as workers, every worker starts with the shard of its own index
+        executor_.ParallelFor(shards_.size(), [&task](size_t shard, size_t) {
+            task(shard);
+            });
+    }
+}
+
+template <class ExecutionPolicy, typename DocumentFilter>
+std::vector<Document> ShardedSearchServer::FindTopShardDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+    DocumentFilter document_filter, size_t top_count) const {
+    CorpusStatistics statistics;
+    for (const SearchServer& shard : shards_) {
+        shard.CollectStatistics(raw_query, statistics);
+    }
+
+    // A shard is searched by a single thread, the shards themselves are the parallelism
+    std::vector<std::vector<Document>> shard_documents(shards_.size());
+    ForEachShard(policy, [&](size_t shard) {
+        shard_documents[shard] = shards_[shard].FindTopDocuments(std::execution::seq, raw_query, statistics, document_filter, top_count);
+        });
+
+    std::vector<Document> matched_documents;
+    for (const std::vector<Document>& documents : shard_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+    }
+    const auto top_end = matched_documents.begin() + std::min(top_count, matched_documents.size());
+    std::partial_sort(matched_documents.begin(), top_end, matched_documents.end(), IsMoreRelevant);
+    matched_documents.erase(top_end, matched_documents.end());
+    return matched_documents;
+}
@@ -0,0 +1,124 @@
+#include "snapshot_file.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::literals;
+
+namespace {
+
+const size_t SNAPSHOT_ALIGNMENT = 8;
+
+size_t AlignSize(size_t size) {
+    return (size + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+    : out_(path, std::ios::binary | std::ios::trunc)
+    , path_(path) {
+    if (!out_) {
+        throw std::runtime_error("Cannot create snapshot "s + path);
+    }
+}
+
+void SnapshotWriter::WriteStrings(const std::vector<std::string_view>& strings) {
+    std::vector<uint64_t> offsets;
+    offsets.reserve(strings.size() + 1);
+    uint64_t offset = 0;
+    offsets.push_back(offset);
+    for (std::string_view text : strings) {
+        offset += text.size();
+        offsets.push_back(offset);
+    }
+    WriteArray(offsets.data(), offsets.size());
+
+    std::string characters;
+    characters.reserve(offset);
+    for (std::string_view text : strings) {
+        characters += text;
+    }
+    WriteArray(characters.data(), characters.size());
+}
+
+void SnapshotWriter::Finish() {
+    out_.flush();
+    if (!out_) {
+        throw std::runtime_error("Cannot write snapshot "s + path_);
+    }
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size) {
+    static const char padding[SNAPSHOT_ALIGNMENT] = {};
+    out_.write(static_cast<const char*>(data), size);
+    out_.write(padding, AlignSize(size) - size);
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open snapshot "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot open snapshot "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map snapshot "s + path);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    // The mapping keeps its own reference to the file
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+const char* MappedFile::GetData() const {
+    return data_;
+}
+
+size_t MappedFile::GetSize() const {
+    return size_;
+}
+
+SnapshotReader::SnapshotReader(const MappedFile& file)
+    : data_(file.GetData())
+    , size_(file.GetSize()) {
+}
+
+std::vector<std::string_view> SnapshotReader::ReadStrings(size_t count) {
+    const uint64_t* offsets = ReadArray<uint64_t>(count + 1);
+    const char* characters = ReadArray<char>(offsets[count]);
+    std::vector<std::string_view> strings;
+    strings.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (offsets[i] > offsets[i + 1]) {
+            throw std::runtime_error("Snapshot is corrupted"s);
+        }
+        strings.emplace_back(characters + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    return strings;
+}
+
+const char* SnapshotReader::ReadBytes(size_t count, size_t element_size) {
+    if (count > (size_ - offset_) / element_size) {
+        throw std::runtime_error("Snapshot is truncated"s);
+    }
+    const size_t size = count * element_size;
+    const char* data = data_ + offset_;
+    offset_ += std::min(AlignSize(size), size_ - offset_);
+    return data;
+}
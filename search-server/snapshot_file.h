@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Sequential writer of a binary snapshot. Every value and array starts at an 8-byte boundary,
+// so a mapped snapshot can be read in place without unaligned access
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+
+    template <typename T>
+    void WriteValue(const T& value) {
+        WriteArray(&value, 1);
+    }
+
+    template <typename T>
+    void WriteArray(const T* data, size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>, "Snapshot values must be trivially copyable");
+        WriteBytes(data, count * sizeof(T));
+    }
+
+    // Offsets of count + 1 string boundaries followed by the characters
+    void WriteStrings(const std::vector<std::string_view>& strings);
+    // Flushes the file, throws std::runtime_error if any write failed
+    void Finish();
+
+private:
+    void WriteBytes(const void* data, size_t size);
+
+    std::ofstream out_;
+    std::string path_;
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const char* GetData() const;
+    size_t GetSize() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Reads what SnapshotWriter wrote. Values point into the mapping and stay valid while it lives.
+// Reading past the end throws std::runtime_error
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const MappedFile& file);
+
+    template <typename T>
+    const T& ReadValue() {
+        return *ReadArray<T>(1);
+    }
+
+    template <typename T>
+    const T* ReadArray(size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>, "Snapshot values must be trivially copyable");
+        return reinterpret_cast<const T*>(ReadBytes(count, sizeof(T)));
+    }
+
+    std::vector<std::string_view> ReadStrings(size_t count);
+
+private:
+    const char* ReadBytes(size_t count, size_t element_size);
+
+    const char* data_;
+    size_t size_;
+    size_t offset_ = 0;
+};
@@ -0,0 +1,248 @@
+#include "socket_connection.h"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+const std::string_view UNIX_PREFIX = "unix:"sv;
+const int LISTEN_BACKLOG = 64;
+
+struct SocketAddress {
+    sockaddr_storage storage = {};
+    socklen_t size = 0;
+    int family = AF_UNSPEC;
+};
+
+// Splits "host:port" or "[ipv6]:port" and checks that the port is a number from 1 to 65535
+std::pair<std::string, std::string> SplitHostPort(const std::string& endpoint) {
+    std::string host;
+    size_t port_start = 0;
+    if (!endpoint.empty() && endpoint.front() == '[') {
+        const size_t host_end = endpoint.find(']');
+        if (host_end == std::string::npos || endpoint.compare(host_end + 1, 1, ":"sv) != 0) {
+            throw std::invalid_argument("Invalid endpoint "s + endpoint + ", expected [address]:port"s);
+        }
+        host = endpoint.substr(1, host_end - 1);
+        port_start = host_end + 2;
+    }
+    else {
+        const size_t separator = endpoint.rfind(':');
+        if (separator == std::string::npos || endpoint.find(':') != separator) {
+            throw std::invalid_argument("Invalid endpoint "s + endpoint + ", expected host:port or [address]:port"s);
+        }
+        host = endpoint.substr(0, separator);
+        port_start = separator + 1;
+    }
+    if (host.empty()) {
+        throw std::invalid_argument("Invalid endpoint "s + endpoint + ", the host is empty"s);
+    }
+
+    const std::string port = endpoint.substr(port_start);
+    unsigned int port_number = 0;
+    const auto [end, error] = std::from_chars(port.data(), port.data() + port.size(), port_number);
+    if (port.empty() || error != std::errc() || end != port.data() + port.size() || port_number == 0 || port_number > 65535) {
+        throw std::invalid_argument("Invalid port "s + port + " in endpoint "s + endpoint + ", expected a number from 1 to 65535"s);
+    }
+    return { host, port };
+}
+
+// A Unix domain socket path gives one address, a host name may resolve to several of IPv4 and IPv6
+std::vector<SocketAddress> ResolveEndpoint(const std::string& endpoint) {
+    if (endpoint.compare(0, UNIX_PREFIX.size(), UNIX_PREFIX) == 0) {
+        SocketAddress address;
+        const std::string path = endpoint.substr(UNIX_PREFIX.size());
+        sockaddr_un* unix_address = reinterpret_cast<sockaddr_un*>(&address.storage);
+        if (path.empty() || path.size() >= sizeof(unix_address->sun_path)) {
+            throw std::invalid_argument("Invalid socket path "s + path);
+        }
+        unix_address->sun_family = AF_UNIX;
+        std::memcpy(unix_address->sun_path, path.c_str(), path.size() + 1);
+        address.size = sizeof(sockaddr_un);
+        address.family = AF_UNIX;
+        return { address };
+    }
+
+    const auto [host, port] = SplitHostPort(endpoint);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+    addrinfo* results = nullptr;
+    const int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &results);
+    if (error != 0) {
+        throw std::runtime_error("Cannot resolve "s + endpoint + ": "s + gai_strerror(error));
+    }
+    std::vector<SocketAddress> addresses;
+    for (const addrinfo* result = results; result != nullptr; result = result->ai_next) {
+        SocketAddress address;
+        std::memcpy(&address.storage, result->ai_addr, result->ai_addrlen);
+        address.size = static_cast<socklen_t>(result->ai_addrlen);
+        address.family = result->ai_family;
+        addresses.push_back(address);
+    }
+    freeaddrinfo(results);
+    return addresses;
+}
+
+std::runtime_error MakeSocketError(std::string_view action, const std::string& endpoint) {
+    return std::runtime_error(std::string(action) + " "s + endpoint + ": "s + std::strerror(errno));
+}
+
+}
+
+Connection::Connection(int fd)
+    : fd_(fd) {
+}
+
+Connection::Connection(Connection&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1)) {
+}
+
+Connection& Connection::operator=(Connection&& other) noexcept {
+    if (this != &other) {
+        Close();
+        fd_ = std::exchange(other.fd_, -1);
+    }
+    return *this;
+}
+
+Connection::~Connection() {
+    Close();
+}
+
+Connection Connection::Connect(const std::string& endpoint) {
+    // Addresses of a host are tried in the order of the resolver, the error of the last one is reported
+    std::optional<std::runtime_error> error;
+    for (const SocketAddress& address : ResolveEndpoint(endpoint)) {
+        Connection connection(socket(address.family, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        if (!connection.IsOpen()) {
+            error = MakeSocketError("Cannot create socket for"sv, endpoint);
+            continue;
+        }
+        if (connect(connection.fd_, reinterpret_cast<const sockaddr*>(&address.storage), address.size) != 0) {
+            error = MakeSocketError("Cannot connect to"sv, endpoint);
+            continue;
+        }
+        if (address.family != AF_UNIX) {
+            // Messages are small and answered at once, batching them would only add latency
+            const int enable = 1;
+            setsockopt(connection.fd_, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+        return connection;
+    }
+    throw error.value_or(std::runtime_error("No address for "s + endpoint));
+}
+
+bool Connection::IsOpen() const {
+    return fd_ >= 0;
+}
+
+int Connection::GetDescriptor() const {
+    return fd_;
+}
+
+void Connection::Close() {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+void Connection::Shutdown() {
+    if (fd_ >= 0) {
+        shutdown(fd_, SHUT_RDWR);
+    }
+}
+
+void Connection::SendAll(std::string_view data) {
+    while (!data.empty()) {
+        // MSG_NOSIGNAL turns a closed peer into an error instead of SIGPIPE
+        const ssize_t sent = send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Cannot send: "s + std::strerror(errno));
+        }
+        data.remove_prefix(static_cast<size_t>(sent));
+    }
+}
+
+bool Connection::Receive(std::string& buffer, bool blocking) {
+    char chunk[64 * 1024];
+    while (true) {
+        const ssize_t received = recv(fd_, chunk, sizeof(chunk), blocking ? 0 : MSG_DONTWAIT);
+        if (received > 0) {
+            buffer.append(chunk, static_cast<size_t>(received));
+            return true;
+        }
+        if (received == 0) {
+            return false;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        }
+        return false;
+    }
+}
+
+// A host with several addresses is listened on at the first one
+Listener::Listener(const std::string& endpoint) {
+    const std::vector<SocketAddress> addresses = ResolveEndpoint(endpoint);
+    if (addresses.empty()) {
+        throw std::runtime_error("No address for "s + endpoint);
+    }
+    const SocketAddress& address = addresses.front();
+    if (address.family == AF_UNIX) {
+        unix_path_ = endpoint.substr(UNIX_PREFIX.size());
+        unlink(unix_path_.c_str());
+    }
+    fd_ = socket(address.family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        throw MakeSocketError("Cannot create socket for"sv, endpoint);
+    }
+    const int enable = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (bind(fd_, reinterpret_cast<const sockaddr*>(&address.storage), address.size) != 0
+        || listen(fd_, LISTEN_BACKLOG) != 0) {
+        const std::runtime_error error = MakeSocketError("Cannot listen on"sv, endpoint);
+        close(fd_);
+        throw error;
+    }
+}
+
+Listener::~Listener() {
+    close(fd_);
+    if (!unix_path_.empty()) {
+        unlink(unix_path_.c_str());
+    }
+}
+
+Connection Listener::Accept() {
+    while (true) {
+        const int fd = accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0 || errno != EINTR) {
+            return Connection(fd);
+        }
+    }
+}
+
+void Listener::Shutdown() {
+    shutdown(fd_, SHUT_RDWR);
+}
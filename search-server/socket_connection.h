@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Stream socket endpoints are written "unix:/path/to/socket" for Unix domain sockets
+// or "host:port" for TCP, e.g. "127.0.0.1:7100", "localhost:7100" or "[::1]:7100".
+// A malformed endpoint or a port outside 1-65535 throws std::invalid_argument
+class Connection {
+public:
+    Connection() = default;
+    explicit Connection(int fd);
+    Connection(Connection&& other) noexcept;
+    Connection& operator=(Connection&& other) noexcept;
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+    ~Connection();
+
+    // Throws std::runtime_error if the host is unknown or nobody listens on the endpoint
+    static Connection Connect(const std::string& endpoint);
+
+    bool IsOpen() const;
+    int GetDescriptor() const;
+    void Close();
+    // Wakes up a thread blocked on the connection, the descriptor stays open
+    void Shutdown();
+
+    // Throws std::runtime_error if the peer is gone
+    void SendAll(std::string_view data);
+    // Appends the bytes that can be read without blocking, or waits for some when blocking.
+    // Returns false once the peer has closed the connection
+    bool Receive(std::string& buffer, bool blocking);
+
+private:
+    int fd_ = -1;
+};
+
+class Listener {
+public:
+    // A Unix domain socket file left by a previous process is replaced
+    explicit Listener(const std::string& endpoint);
+    Listener(const Listener&) = delete;
+    Listener& operator=(const Listener&) = delete;
+    ~Listener();
+
+    // Returns a closed connection once Shutdown has been called
+    Connection Accept();
+    void Shutdown();
+
+private:
+    int fd_ = -1;
+    std::string unix_path_;
+};
@@ -1,43 +1,115 @@
 #include "string_processing.h" 
 #include <algorithm>
+#include <cstdint>
 #include <execution>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Bit i is set when byte i of a block is a space or a control character
+struct BlockMasks {
+    uint32_t spaces;
+    uint32_t controls;
+};
+
+#if defined(__AVX2__)
+const size_t BLOCK_SIZE = 32;
+
+BlockMasks ScanBlock(const char* data) {
+    const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    const __m256i spaces = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+    // A byte is at most 31 as unsigned exactly when min(byte, 31) equals it
+    const __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, _mm256_set1_epi8(31)), bytes);
+    return { static_cast<uint32_t>(_mm256_movemask_epi8(spaces)), static_cast<uint32_t>(_mm256_movemask_epi8(controls)) };
+}
+#elif defined(__SSE2__)
+const size_t BLOCK_SIZE = 16;
+
+BlockMasks ScanBlock(const char* data) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i spaces = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    // A byte is at most 31 as unsigned exactly when min(byte, 31) equals it
+    const __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(bytes, _mm_set1_epi8(31)), bytes);
+    return { static_cast<uint32_t>(_mm_movemask_epi8(spaces)), static_cast<uint32_t>(_mm_movemask_epi8(controls)) };
+}
+#else
+const size_t BLOCK_SIZE = 32;
+#endif
+
+BlockMasks ScanBytes(const char* data, size_t size) {
+    BlockMasks masks = { 0, 0 };
+    for (size_t i = 0; i < size; ++i) {
+        const unsigned char c = static_cast<unsigned char>(data[i]);
+        masks.spaces |= static_cast<uint32_t>(c == ' ') << i;
+        masks.controls |= static_cast<uint32_t>(c < ' ') << i;
+    }
+    return masks;
+}
+
+int GetHighestBit(uint32_t mask) {
+    return 31 - __builtin_clz(mask);
+}
+
+}
 
 //    
 std::vector<std::string> SplitIntoWords(const std::string& text) {
+    std::vector<WordToken> tokens;
+    SplitIntoWords(std::string_view(text), tokens);
     std::vector<std::string> words;
-    std::string word;
-    for (const char c : text) {
-        if (c == ' ') {
-            if (!word.empty()) {
-                words.push_back(word);
-                word.clear();
-            }
+    words.reserve(tokens.size());
+    for (const WordToken& token : tokens) {
+        if (!token.word.empty()) {
+            words.emplace_back(token.word);
         }
-        else {
-            word += c;
-        }
-    }
-    if (!word.empty()) {
-        words.push_back(word);
     }
     return words;
 }
 
 //    
 std::vector<std::string_view> SplitIntoWords(const std::string_view& text) {
+    std::vector<WordToken> tokens;
+    SplitIntoWords(text, tokens);
     std::vector<std::string_view> result;
-    int64_t pos = 0;
-    const int64_t pos_end = text.npos;
-    while (true) {
-        int64_t space = text.find(' ', pos);
-        result.push_back(space == pos_end ? text.substr(pos) : text.substr(pos, space - pos));
-        if (space == pos_end) {
-            break;
+    result.reserve(tokens.size());
+    for (const WordToken& token : tokens) {
+        result.push_back(token.word);
+    }
+    return result;
+}
+
+void SplitIntoWords(std::string_view text, std::vector<WordToken>& words) {
+    words.clear();
+    size_t word_begin = 0;
+    // Position right after the last control character seen so far
+    size_t control_end = 0;
+    const auto add_block_words = [&](BlockMasks masks, size_t block_begin) {
+        for (uint32_t spaces = masks.spaces; spaces != 0; spaces &= spaces - 1) {
+            const int bit = __builtin_ctz(spaces);
+            const uint32_t controls_before = masks.controls & ((uint32_t{ 1 } << bit) - 1);
+            if (controls_before != 0) {
+                control_end = std::max(control_end, block_begin + GetHighestBit(controls_before) + 1);
+            }
+            const size_t word_end = block_begin + bit;
+            words.push_back({ text.substr(word_begin, word_end - word_begin), control_end > word_begin });
+            word_begin = word_end + 1;
         }
-        else {
-            pos = space + 1;
+        if (masks.controls != 0) {
+            control_end = std::max(control_end, block_begin + GetHighestBit(masks.controls) + 1);
         }
+    };
+
+    size_t block_begin = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; block_begin + BLOCK_SIZE <= text.size(); block_begin += BLOCK_SIZE) {
+        add_block_words(ScanBlock(text.data() + block_begin), block_begin);
     }
-    return result;
-}
\ No newline at end of file
+#endif
+    for (; block_begin < text.size(); block_begin += BLOCK_SIZE) {
+        add_block_words(ScanBytes(text.data() + block_begin, std::min(BLOCK_SIZE, text.size() - block_begin)), block_begin);
+    }
+    words.push_back({ text.substr(word_begin), control_end > word_begin });
+}
@@ -6,10 +6,21 @@
 
 
 
+// Word of a text and whether it contains control characters, which make a word invalid
+struct WordToken {
+    std::string_view word;
+    bool has_control_chars;
+};
+
 std::vector<std::string> SplitIntoWords(const std::string& text);
 
 std::vector<std::string_view> SplitIntoWords(const std::string_view& text);
 
+// Splits text at every space like SplitIntoWords, so consecutive, leading and trailing spaces give
+// empty words. Spaces and control characters are found in one vectorized pass. words is cleared
+// first, a buffer reused between calls stops allocating once it is large enough
+void SplitIntoWords(std::string_view text, std::vector<WordToken>& words);
+
 
 
 template <typename StringContainer>
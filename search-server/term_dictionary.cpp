@@ -0,0 +1,147 @@
+#include "term_dictionary.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <utility>
+
+StringArena::StringArena(size_t block_size)
+    : block_size_(block_size) {
+}
+
+StringArena::StringArena(StringArena&& other) noexcept
+    : block_size_(other.block_size_)
+    , blocks_(std::move(other.blocks_))
+    , current_(std::exchange(other.current_, nullptr))
+    , left_(std::exchange(other.left_, 0)) {
+}
+
+StringArena& StringArena::operator=(StringArena&& other) noexcept {
+    block_size_ = other.block_size_;
+    blocks_ = std::move(other.blocks_);
+    current_ = std::exchange(other.current_, nullptr);
+    left_ = std::exchange(other.left_, 0);
+    return *this;
+}
+
+std::string_view StringArena::Store(std::string_view text) {
+    if (text.size() > left_) {
+        // Oversized strings get a block of their own
+        const size_t size = std::max(block_size_, text.size());
+        blocks_.emplace_back(new char[size]);
+        current_ = blocks_.back().get();
+        left_ = size;
+    }
+    char* begin = current_;
+    std::memcpy(begin, text.data(), text.size());
+    current_ += text.size();
+    left_ -= text.size();
+    return { begin, text.size() };
+}
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+    : slots_(other.slots_)
+    , sorted_ids_(other.sorted_ids_) {
+    id_to_term_.reserve(other.id_to_term_.size());
+    for (std::string_view term : other.id_to_term_) {
+        id_to_term_.push_back(arena_.Store(term));
+    }
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+    if (this != &other) {
+        TermDictionary copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+size_t TermDictionary::Intern(std::string_view term) {
+    if (slots_.empty()) {
+        Rehash(MIN_SLOT_COUNT);
+    }
+    const uint64_t hash = GetHash(term);
+    size_t slot = FindSlot(term, hash);
+    if (slots_[slot].term_id != EMPTY_SLOT) {
+        return slots_[slot].term_id;
+    }
+
+    const size_t term_id = id_to_term_.size();
+    id_to_term_.push_back(arena_.Store(term));
+    slots_[slot] = { static_cast<uint32_t>(hash >> 32), static_cast<uint32_t>(term_id) };
+    // Load factor stays below 3/4
+    if (4 * id_to_term_.size() > 3 * slots_.size()) {
+        Rehash(2 * slots_.size());
+    }
+    // Sorting when the new terms reach a fraction of the sorted ones keeps the cost of adding a term logarithmic
+    if (id_to_term_.size() - sorted_ids_.size() >= std::max(MIN_UNSORTED_TERMS, sorted_ids_.size() / 8)) {
+        SortNewTerms();
+    }
+    return term_id;
+}
+
+size_t TermDictionary::Find(std::string_view term) const {
+    if (slots_.empty()) {
+        return npos;
+    }
+    const Slot& slot = slots_[FindSlot(term, GetHash(term))];
+    return slot.term_id == EMPTY_SLOT ? npos : slot.term_id;
+}
+
+std::string_view TermDictionary::GetTerm(size_t term_id) const {
+    return id_to_term_[term_id];
+}
+
+size_t TermDictionary::Size() const {
+    return id_to_term_.size();
+}
+
+uint64_t TermDictionary::GetHash(std::string_view term) {
+    return std::hash<std::string_view>{}(term);
+}
+
+size_t TermDictionary::FindSlot(std::string_view term, uint64_t hash) const {
+    const size_t mask = slots_.size() - 1;
+    const uint32_t short_hash = static_cast<uint32_t>(hash >> 32);
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        const Slot& candidate = slots_[slot];
+        if (candidate.term_id == EMPTY_SLOT
+            || (candidate.hash == short_hash && id_to_term_[candidate.term_id] == term)) {
+            return slot;
+        }
+    }
+}
+
+void TermDictionary::Rehash(size_t slot_count) {
+    slots_.assign(slot_count, Slot());
+    const size_t mask = slot_count - 1;
+    for (size_t term_id = 0; term_id < id_to_term_.size(); ++term_id) {
+        const uint64_t hash = GetHash(id_to_term_[term_id]);
+        size_t slot = hash & mask;
+        while (slots_[slot].term_id != EMPTY_SLOT) {
+            slot = (slot + 1) & mask;
+        }
+        slots_[slot] = { static_cast<uint32_t>(hash >> 32), static_cast<uint32_t>(term_id) };
+    }
+}
+
+size_t TermDictionary::LowerBound(std::string_view term) const {
+    return std::lower_bound(sorted_ids_.begin(), sorted_ids_.end(), term, [this](uint32_t term_id, std::string_view term) {
+        return id_to_term_[term_id] < term;
+        }) - sorted_ids_.begin();
+}
+
+void TermDictionary::SortNewTerms() {
+    const auto term_less = [this](uint32_t lhs, uint32_t rhs) {
+        return id_to_term_[lhs] < id_to_term_[rhs];
+    };
+    std::vector<uint32_t> new_ids(id_to_term_.size() - sorted_ids_.size());
+    std::iota(new_ids.begin(), new_ids.end(), static_cast<uint32_t>(sorted_ids_.size()));
+    std::sort(new_ids.begin(), new_ids.end(), term_less);
+
+    std::vector<uint32_t> sorted_ids;
+    sorted_ids.reserve(id_to_term_.size());
+    std::merge(sorted_ids_.begin(), sorted_ids_.end(), new_ids.begin(), new_ids.end(), std::back_inserter(sorted_ids), term_less);
+    sorted_ids_ = std::move(sorted_ids);
+}
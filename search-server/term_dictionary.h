@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for immutable strings. Stored characters never move,
+// so views returned by Store stay valid for the arena lifetime
+class StringArena {
+public:
+    explicit StringArena(size_t block_size = 64 * 1024);
+    StringArena(StringArena&& other) noexcept;
+    StringArena& operator=(StringArena&& other) noexcept;
+
+    std::string_view Store(std::string_view text);
+
+private:
+    size_t block_size_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* current_ = nullptr;
+    size_t left_ = 0;
+};
+
+// Assigns dense ids to distinct terms. Each term is copied into the arena once, the indexes over it
+// hold only 32-bit ids: an open-addressing hash table for exact lookups and the ids sorted by term,
+// which turns a prefix into a contiguous range. New terms are merged into the sorted ids in batches
+class TermDictionary {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    TermDictionary() = default;
+    TermDictionary(const TermDictionary& other);
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(const TermDictionary& other);
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    // Returns id of the term, adding it on first use
+    size_t Intern(std::string_view term);
+    // Returns npos for unknown terms
+    size_t Find(std::string_view term) const;
+    std::string_view GetTerm(size_t term_id) const;
+    size_t Size() const;
+
+    // Calls callback(term_id) for every term starting with prefix, in no particular order
+    template <typename Callback>
+    void ForEachWithPrefix(std::string_view prefix, Callback callback) const;
+
+private:
+    static constexpr uint32_t EMPTY_SLOT = static_cast<uint32_t>(-1);
+    static constexpr size_t MIN_SLOT_COUNT = 16;
+    static constexpr size_t MIN_UNSORTED_TERMS = 1024;
+
+    // Part of the term hash is kept in the slot, so probing rarely has to read other terms
+    struct Slot {
+        uint32_t hash = 0;
+        uint32_t term_id = EMPTY_SLOT;
+    };
+
+    static uint64_t GetHash(std::string_view term);
+    // Slot holding the term, or the empty slot where it would be inserted
+    size_t FindSlot(std::string_view term, uint64_t hash) const;
+    void Rehash(size_t slot_count);
+    // Position in sorted_ids_ of the first term not less than term
+    size_t LowerBound(std::string_view term) const;
+    void SortNewTerms();
+
+    StringArena arena_;
+    std::vector<std::string_view> id_to_term_;
+    // Linear probing, the number of slots is a power of two
+    std::vector<Slot> slots_;
+    // Ids [0, sorted_ids_.size()) in term order, later ids are not sorted yet
+    std::vector<uint32_t> sorted_ids_;
+};
+
+template <typename Callback>
+void TermDictionary::ForEachWithPrefix(std::string_view prefix, Callback callback) const {
+    for (size_t pos = LowerBound(prefix); pos < sorted_ids_.size(); ++pos) {
+        const uint32_t term_id = sorted_ids_[pos];
+        if (id_to_term_[term_id].substr(0, prefix.size()) != prefix) {
+            break;
+        }
+        callback(static_cast<size_t>(term_id));
+    }
+    for (size_t term_id = sorted_ids_.size(); term_id < id_to_term_.size(); ++term_id) {
+        if (id_to_term_[term_id].substr(0, prefix.size()) == prefix) {
+            callback(term_id);
+        }
+    }
+}
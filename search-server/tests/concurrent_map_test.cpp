@@ -0,0 +1,93 @@
+// Checks that ConcurrentMap holds any number of keys: maps built with a small expected key count
+// take many times more keys through operator[] and Add, from one thread and from several, and
+// BuildOrdinaryMap returns exactly what was written.
+//
+// Build and run from the search-server directory:
+//   g++ -std=c++17 -O2 -I. tests/concurrent_map_test.cpp -ltbb -lpthread -o concurrent_map_test
+//   ./concurrent_map_test
+// Exits with 1 if any check fails
+
+#include "concurrent_map.h"
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+int failure_count = 0;
+
+void Check(std::string_view name, bool passed) {
+    std::cout << name << ": "sv << (passed ? "ok"sv : "failed"sv) << std::endl;
+    if (!passed) {
+        ++failure_count;
+    }
+}
+
+// Like the old bucket-count interface was used: a hundred buckets, a thousand times more keys
+void CheckSequentialGrowth() {
+    const int key_count = 100000;
+    ConcurrentMap<int, double> map(100);
+    for (int key = 0; key < key_count; ++key) {
+        map[key].ref_to_value += key;
+        map[key].ref_to_value += 0.5;
+    }
+
+    bool values_match = true;
+    for (int key = 0; key < key_count; ++key) {
+        values_match = values_match && map.Get(key) == key + 0.5;
+    }
+    const std::map<int, double> ordinary_map = map.BuildOrdinaryMap();
+    Check("operator[] past the expected key count"sv, values_match && ordinary_map.size() == static_cast<size_t>(key_count)
+        && ordinary_map.begin()->first == 0 && ordinary_map.rbegin()->first == key_count - 1);
+    Check("absent key"sv, map.Get(key_count) == 0.0 && map.Get(-1) == 0.0);
+}
+
+// Threads insert the same keys in different orders while the shards grow
+void CheckConcurrentGrowth() {
+    const size_t thread_count = 8;
+    const uint64_t key_count = 200000;
+    ConcurrentMap<uint64_t, int64_t> map(16, 4);
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < thread_count; ++thread) {
+        threads.emplace_back([&map, thread] {
+            for (uint64_t i = 0; i < key_count; ++i) {
+                const uint64_t key = thread % 2 == 0 ? i : key_count - 1 - i;
+                if (thread % 3 == 0) {
+                    map[key].ref_to_value += 1;
+                }
+                else {
+                    map.Add(key, 1);
+                }
+            }
+            });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    const std::map<uint64_t, int64_t> ordinary_map = map.BuildOrdinaryMap(std::execution::par);
+    bool values_match = ordinary_map.size() == key_count;
+    for (const auto& [key, value] : ordinary_map) {
+        values_match = values_match && key < key_count && value == static_cast<int64_t>(thread_count);
+    }
+    Check("concurrent inserts past the expected key count"sv, values_match);
+}
+
+}
+
+int main() {
+    CheckSequentialGrowth();
+    CheckConcurrentGrowth();
+    if (failure_count > 0) {
+        std::cout << "FAILED"sv << std::endl;
+        return 1;
+    }
+    std::cout << "PASSED"sv << std::endl;
+    return 0;
+}
@@ -0,0 +1,134 @@
+// Checks that the sequential query path runs on the per-thread query arena: after warm-up,
+// FindTopDocuments and MatchDocument allocate nothing on the global heap except the vector they return,
+// FindTopDocumentsInto allocates nothing at all.
+//
+// Build and run from the search-server directory:
+//   g++ -std=c++17 -O2 -I. tests/query_allocation_test.cpp benchmark/corpus_generator.cpp $(ls *.cpp | grep -v main.cpp) -ltbb -lpthread -o query_allocation_test
+//   ./query_allocation_test
+// Exits with 1 if any check fails
+
+#include "benchmark/corpus_generator.h"
+#include "search_server.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+std::atomic<size_t> allocation_count = 0;
+
+void* CountedAllocate(size_t size, size_t alignment) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void* p = alignment <= alignof(std::max_align_t)
+        ? std::malloc(size == 0 ? 1 : size)
+        : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+}
+
+void* operator new(size_t size) {
+    return CountedAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+const size_t DOCUMENT_COUNT = 20000;
+const size_t QUERY_COUNT = 200;
+
+int failure_count = 0;
+
+// Runs query(i) for every query twice: the first round warms up the arena, the second one must
+// allocate only the returned vectors. query returns how many of those it allocated
+template <typename Query>
+void CheckAllocations(std::string_view name, Query query) {
+    for (size_t i = 0; i < QUERY_COUNT; ++i) {
+        query(i);
+    }
+    size_t result_allocation_count = 0;
+    const size_t before = allocation_count.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < QUERY_COUNT; ++i) {
+        result_allocation_count += query(i);
+    }
+    const size_t query_allocation_count = allocation_count.load(std::memory_order_relaxed) - before - result_allocation_count;
+    std::cout << name << ": "sv << query_allocation_count << " allocations besides the results of "sv
+        << QUERY_COUNT << " queries"sv << std::endl;
+    if (query_allocation_count != 0) {
+        ++failure_count;
+    }
+}
+
+}
+
+int main() {
+    CorpusGenerator generator(CorpusOptions{});
+    SearchServer server(generator.GetStopWords(5));
+    const std::vector<std::string> documents = generator.GenerateDocuments(DOCUMENT_COUNT);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        server.AddDocument(static_cast<int>(i), documents[i], static_cast<DocumentStatus>(i % 4), { 1, 2, 3 });
+    }
+    std::vector<std::string> queries = generator.GenerateQueries(QUERY_COUNT, 6, 1);
+    for (size_t i = 0; i < queries.size(); i += 2) {
+        // Repeated plus words and stop words go through the deduplication too
+        queries[i] += ' ' + generator.GetWord(0) + ' ' + generator.GetWord(100) + ' ' + generator.GetWord(100);
+    }
+
+    for (const QueryEvaluation evaluation : { QueryEvaluation::EXHAUSTIVE, QueryEvaluation::DYNAMIC_PRUNING }) {
+        server.SetQueryEvaluation(evaluation);
+        const std::string_view mode = evaluation == QueryEvaluation::EXHAUSTIVE ? "exhaustive"sv : "dynamic pruning"sv;
+        std::cout << mode << std::endl;
+        CheckAllocations("  FindTopDocuments by status"sv, [&](size_t i) {
+            return server.FindTopDocuments(queries[i]).empty() ? 0 : 1;
+            });
+        CheckAllocations("  FindTopDocumentsInto"sv, [&](size_t i) {
+            Document output[MAX_RESULT_DOCUMENT_COUNT];
+            server.FindTopDocumentsInto(std::execution::seq, queries[i], DocumentStatus::ACTUAL, output);
+            return 0;
+            });
+        CheckAllocations("  FindTopDocuments by predicate"sv, [&](size_t i) {
+            return server.FindTopDocuments(queries[i], [](int document_id, DocumentStatus, int) {
+                return document_id % 2 == 0;
+                }).empty() ? 0 : 1;
+            });
+    }
+    CheckAllocations("MatchDocument"sv, [&](size_t i) {
+        return std::get<0>(server.MatchDocument(queries[i], static_cast<int>(i * 97 % DOCUMENT_COUNT))).empty() ? 0 : 1;
+        });
+
+    if (failure_count > 0) {
+        std::cout << "FAILED"sv << std::endl;
+        return 1;
+    }
+    std::cout << "PASSED"sv << std::endl;
+    return 0;
+}